@@ -0,0 +1,332 @@
+#include <chrono>
+#include <iostream>
+#include <iomanip>
+#include <map>
+#include <string>
+#include <vector>
+
+#define PAIRSIM_BENCH_ALLOCATIONS
+#include "../common/bench.hpp"
+
+/**
+ * What a thread is doing, to attribute its allocations to.
+ */
+enum AllocPhase {
+    /** Model step. */
+    STEP = 0,
+
+    /** Rest of getData: device serialization, packets and TICK. */
+    SERIALIZE,
+
+    /** sendData: handing queued packets to the transport. */
+    FLUSH,
+
+    /** Inside Transport::recv. */
+    RECV,
+
+    /** Rest of Node::receive: decoding and bookkeeping. */
+    DECODE,
+
+    /** Node::dispatch: packet handlers, e.g. device deserialization, and
+     * freeing the decoded packet. */
+    DISPATCH,
+
+    /** Anything else, e.g. setup. */
+    OTHER,
+
+    ALLOC_PHASE_COUNT,
+};
+
+static const char* const PHASE_NAMES[] = {"step", "serialize", "flush", "recv", "decode", "dispatch", "other"};
+
+/**
+ * Allocations of one side, by phase.
+ */
+struct Allocations {
+    benchmarks::AllocationCounts phases[ALLOC_PHASE_COUNT];
+};
+
+/** Where this thread's allocations are counted, if anywhere. */
+static thread_local Allocations* counting = nullptr;
+static thread_local AllocPhase phase = OTHER;
+
+/**
+ * Points the allocation hook at this thread's current phase, if counting.
+ */
+static void countPhase() {
+    benchmarks::allocationCounts = counting != nullptr ? &counting->phases[phase] : nullptr;
+}
+
+/**
+ * Starts or stops counting this thread's allocations.
+ * \param allocations Where to count them, null to stop.
+ */
+static void countInto(Allocations* allocations) {
+    counting = allocations;
+    countPhase();
+}
+
+/**
+ * Attributes this thread's allocations to a phase while in scope.
+ */
+class PhaseScope {
+private:
+    AllocPhase previous;
+
+public:
+    PhaseScope(AllocPhase _phase) : previous{phase} {
+        phase = _phase;
+        countPhase();
+    }
+
+    ~PhaseScope() {
+        phase = previous;
+        countPhase();
+    }
+};
+
+/**
+ * Harness settings, all overridable with --name=value.
+ */
+struct Config {
+    std::string address = "tcp://127.0.0.1:4211";
+    size_t devices = 100;
+    size_t actions = 1;
+    size_t ticks = 1000;
+    size_t warmup = 100;
+
+    /** Largest steady state allocations per tick, client and server
+     * together, before failing. 0 to only report. */
+    double maxAllocs = 0;
+};
+
+/**
+ * Transport marking the time spent receiving as such.
+ */
+class PhaseTransport : public ps::Transport {
+private:
+    std::unique_ptr<ps::Transport> inner;
+
+public:
+    PhaseTransport(std::unique_ptr<ps::Transport> _inner) : inner{std::move(_inner)} {}
+
+    void listen(const std::string& address) { inner->listen(address); }
+    void dial(const std::string& address) { inner->dial(address); }
+    void send(const std::uint8_t* data, std::size_t size) { inner->send(data, size); }
+    void flush() { inner->flush(); }
+    bool direct() { return inner->direct(); }
+    void sendDevice(ps::Device* device) { inner->sendDevice(device); }
+    ps::Device* receivedDevice() { return inner->receivedDevice(); }
+    bool stats(ps::TransportStats& stats) { return inner->stats(stats); }
+
+    ps::BufferView recv() {
+        PhaseScope scope{RECV};
+        return inner->recv();
+    }
+};
+
+class PhaseClientModel : public benchmarks::PointClientModel {
+private:
+    const Config& config;
+
+public:
+    PhaseClientModel(const Config& _config) : benchmarks::PointClientModel{_config.devices}, config{_config} {}
+
+    void step(ps::Client<>* client) {
+        PhaseScope scope{STEP};
+        benchmarks::PointClientModel::step(client);
+        for (size_t i = 0; i < config.actions; i++) {
+            json params;
+            params["i"] = i;
+            client->sendAction("count", params);
+        }
+    }
+};
+
+class PhaseServerModel : public benchmarks::PointServerModel {
+private:
+    size_t actions;
+
+public:
+    PhaseServerModel() : actions{0} {}
+
+    void setup(ps::Server<>* server) {
+        server->addAction("count", [this](json params) {
+            actions++;
+        });
+    }
+
+    void step(ps::Server<>* server) {
+        PhaseScope scope{STEP};
+    }
+};
+
+/**
+ * Node marking its lockstep calls as phases. Waiting for a TICK runs the
+ * same receive and dispatch loop as Node::waitFor, split in phases.
+ */
+template <typename Base>
+class PhaseNode : public Base {
+public:
+    void setup() {
+        Base::setup();
+        this->transport.reset(new PhaseTransport(std::move(this->transport)));
+    }
+
+    void getData() {
+        PhaseScope scope{SERIALIZE};
+        Base::getData();
+    }
+
+    void sendData() {
+        PhaseScope scope{FLUSH};
+        Base::sendData();
+    }
+
+    void waitTick() {
+        bool ticked = false;
+        while (!ticked && this->running) {
+            // freeing the decoded message counts as dispatch too
+            PhaseScope scope{DISPATCH};
+            json msg;
+            ps::PacketType packetType;
+            {
+                PhaseScope decode{DECODE};
+                packetType = this->receive(msg);
+            }
+            if (!msg.is_null()) {
+                this->dispatch(packetType, msg);
+            }
+            ticked = packetType == ps::PacketType::TICK;
+        }
+    }
+};
+
+/**
+ * Runs a server until the client ends the session, counting from the
+ * first tick after warmup.
+ */
+static void runServer(const Config& config, Allocations& allocations, size_t& ticks) {
+    PhaseNode<ps::Server<>> server;
+    server.setServerAddr(config.address);
+    server.setModel(std::make_shared<PhaseServerModel>());
+    server.setup();
+
+    for (;;) {
+        server.waitTick();
+        if (server.shouldEnd()) {
+            break;
+        }
+        if (++ticks == config.warmup + 1) {
+            countInto(&allocations);
+        }
+        server.getData();
+        server.sendData();
+    }
+
+    countInto(nullptr);
+    ticks -= std::min(ticks, config.warmup);
+}
+
+/**
+ * Runs a client for the configured ticks after warmup.
+ */
+static void runClient(const Config& config, Allocations& allocations) {
+    PhaseNode<ps::Client<>> client;
+    client.setServerAddr(config.address);
+    client.setRetryDelay(std::chrono::milliseconds(100));
+    client.setModel(std::make_shared<PhaseClientModel>(config));
+    client.setup();
+
+    for (size_t i = 0; i < config.warmup; i++) {
+        client.tick();
+    }
+
+    countInto(&allocations);
+    for (size_t i = 0; i < config.ticks; i++) {
+        client.tick();
+    }
+    countInto(nullptr);
+
+    client.end();
+}
+
+/**
+ * Prints allocations per tick by phase.
+ * \returns Allocations per tick, over every phase.
+ */
+static double report(const std::string& side, const Allocations& a, size_t ticks) {
+    const double n = ticks > 0 ? ticks : 1;
+    size_t count = 0;
+    size_t bytes = 0;
+
+    std::cout << side << " (" << ticks << " ticks):" << std::endl
+              << "  " << std::left << std::setw(12) << "phase" << std::right
+              << std::setw(14) << "allocs/tick" << std::setw(14) << "bytes/tick" << std::endl;
+    for (int p = 0; p < ALLOC_PHASE_COUNT; p++) {
+        std::cout << "  " << std::left << std::setw(12) << PHASE_NAMES[p] << std::right << std::fixed
+                  << std::setprecision(1) << std::setw(14) << a.phases[p].count / n
+                  << std::setprecision(0) << std::setw(14) << a.phases[p].bytes / n << std::endl;
+        count += a.phases[p].count;
+        bytes += a.phases[p].bytes;
+    }
+    std::cout << "  " << std::left << std::setw(12) << "total" << std::right
+              << std::setprecision(1) << std::setw(14) << count / n
+              << std::setprecision(0) << std::setw(14) << bytes / n << std::endl;
+
+    return count / n;
+}
+
+static bool parse(int argc, char** argv, Config& config) {
+    std::map<std::string, std::string> args;
+    if (!benchmarks::parseArgs(argc, argv, args)) {
+        return false;
+    }
+
+    for (const auto& arg : args) {
+        const std::string& k = arg.first;
+        const std::string& v = arg.second;
+
+        if (k == "address") config.address = v;
+        else if (k == "devices") config.devices = std::stoul(v);
+        else if (k == "actions") config.actions = std::stoul(v);
+        else if (k == "ticks") config.ticks = std::stoul(v);
+        else if (k == "warmup") config.warmup = std::stoul(v);
+        else if (k == "max-allocs") config.maxAllocs = std::stod(v);
+        else return false;
+    }
+
+    return config.ticks > 0;
+}
+
+int main(int argc, char** argv) {
+    Config config;
+    if (!parse(argc, argv, config)) {
+        std::cerr << "usage: " << argv[0] << " [--address=tcp://127.0.0.1:4211] [--devices=100] [--actions=1]" << std::endl
+                  << "    [--ticks=1000] [--warmup=100] [--max-allocs=0]" << std::endl;
+        return 1;
+    }
+
+    std::cout << config.address << ": " << config.devices << " devices, " << config.actions
+              << " actions/tick" << std::endl;
+
+    Allocations serverAllocations, clientAllocations;
+    size_t serverTicks = 0;
+
+    benchmarks::runPair([&]() {
+        runServer(config, serverAllocations, serverTicks);
+    }, [&]() {
+        runClient(config, clientAllocations);
+    });
+
+    const double perTick = report("client", clientAllocations, config.ticks)
+                         + report("server", serverAllocations, serverTicks);
+
+    std::cout << "steady state allocs/tick " << std::setprecision(1) << perTick << std::endl;
+    if (config.maxAllocs > 0 && perTick > config.maxAllocs) {
+        std::cerr << "FAIL: more than " << config.maxAllocs << " allocs/tick" << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1 @@
+g++ allocs.cpp -o allocs -std=c++17 -O2 -lpthread -lnng -I../../include -I../../examples/omnet_module/src/include -Wall
@@ -0,0 +1,275 @@
+#include <chrono>
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+
+#define PAIRSIM_BENCH_ALLOCATIONS
+#include "../common/bench.hpp"
+#include "../../examples/simple_server/plane.hpp"
+
+/** Allocations made by the main thread, counted from main() on. */
+static benchmarks::AllocationCounts allocations;
+
+/**
+ * Keeps the compiler from optimizing a value away.
+ */
+template <typename T>
+static void keep(T& value) {
+    asm volatile("" : : "r"(&value) : "memory");
+}
+
+/**
+ * Device whose serialized state has a configurable shape.
+ */
+class ShapeDevice : public ps::Device {
+public:
+    enum Shape {
+        FLAT,
+        WIDE,
+        ARRAY,
+        BINARY,
+        TEXT,
+    };
+
+private:
+    Shape shape;
+    std::vector<double> values;
+    std::vector<std::uint8_t> blob;
+    std::string text;
+
+public:
+    ShapeDevice(Shape _shape) : ps::Device{"shape"}, shape{_shape}, values(64), blob(256), text(256, 'x') {
+        for (size_t i = 0; i < values.size(); i++) {
+            values[i] = i * 1.5;
+        }
+    }
+
+    json serialize() {
+        json j;
+
+        switch (shape) {
+            case FLAT:
+                j["x"] = values[0];
+                j["y"] = values[1];
+                j["z"] = values[2];
+                break;
+            case WIDE:
+                for (size_t i = 0; i < 32; i++) {
+                    j["f" + std::to_string(i)] = values[i];
+                }
+                break;
+            case ARRAY:
+                j["v"] = values;
+                break;
+            case BINARY:
+                j["b"] = json::binary(blob);
+                break;
+            case TEXT:
+                j["s"] = text;
+                break;
+        }
+
+        return j;
+    }
+
+    void deserialize(json j) {
+        switch (shape) {
+            case FLAT:
+                values[0] = j["x"].get<double>();
+                values[1] = j["y"].get<double>();
+                values[2] = j["z"].get<double>();
+                break;
+            case WIDE:
+                for (size_t i = 0; i < 32; i++) {
+                    values[i] = j["f" + std::to_string(i)].get<double>();
+                }
+                break;
+            case ARRAY:
+                values = j["v"].get<std::vector<double>>();
+                break;
+            case BINARY:
+                blob = j["b"].get_binary();
+                break;
+            case TEXT:
+                text = j["s"].get<std::string>();
+                break;
+        }
+    }
+};
+
+/**
+ * Runs fn repeatedly for a while and prints ns/op, bytes/op and
+ * allocations/op. fn returns the bytes it produced or consumed.
+ */
+template <typename Fn>
+static void bench(const std::string& name, Fn fn) {
+    // warm up caches and the allocator
+    for (int i = 0; i < 100; i++) {
+        fn();
+    }
+
+    size_t iterations = 0;
+    size_t bytes = 0;
+    size_t allocs = 0;
+    const auto start = std::chrono::steady_clock::now();
+    std::chrono::steady_clock::duration elapsed{0};
+
+    while (elapsed < std::chrono::milliseconds(200)) {
+        const size_t before = allocations.count;
+        for (int i = 0; i < 100; i++) {
+            bytes += fn();
+        }
+        allocs += allocations.count - before;
+        iterations += 100;
+        elapsed = std::chrono::steady_clock::now() - start;
+    }
+
+    const double ns = std::chrono::duration<double, std::nano>(elapsed).count();
+    std::cout << std::left << std::setw(36) << name << std::right << std::fixed
+              << std::setprecision(1) << std::setw(12) << ns / iterations
+              << std::setprecision(0) << std::setw(12) << (double) bytes / iterations
+              << std::setprecision(1) << std::setw(12) << (double) allocs / iterations << std::endl;
+}
+
+/**
+ * Benchmarks a control packet builder and its decoding.
+ */
+template <typename Builder>
+static void benchControl(const std::string& name, Builder builder) {
+    bench("packet::" + name, [&]() {
+        ps::Buffer buf = builder();
+        keep(buf);
+        return buf.size();
+    });
+
+    const ps::Buffer encoded = builder();
+    bench("decode " + name, [&]() {
+        json j = ps::packet::decode(encoded.data(), encoded.size());
+        keep(j);
+        return encoded.size();
+    });
+}
+
+/**
+ * Benchmarks the DEVICE path of one device: serialize, the packet
+ * builder, decode and deserialize.
+ */
+template <typename DevicePtrType>
+static void benchDevice(const std::string& name, DevicePtrType d) {
+    bench(name + " serialize", [&]() {
+        json j = d->serialize();
+        keep(j);
+        return 0;
+    });
+    bench(name + " packet::device", [&]() {
+        ps::Buffer buf = ps::packet::device(d);
+        keep(buf);
+        return buf.size();
+    });
+
+    const ps::Buffer encoded = ps::packet::device(d);
+    bench(name + " decode", [&]() {
+        json j = ps::packet::decode(encoded.data(), encoded.size());
+        keep(j);
+        return encoded.size();
+    });
+
+    const json decoded = ps::packet::decode(encoded.data(), encoded.size());
+    bench(name + " deserialize", [&]() {
+        d->deserialize(decoded["d"]);
+        return 0;
+    });
+}
+
+/**
+ * Creates an example plane at some position.
+ */
+static std::shared_ptr<Plane> makePlane(float x, float y, float z) {
+    auto p = std::make_shared<Plane>();
+
+    json j;
+    j["pos"]["x"] = x;
+    j["pos"]["y"] = y;
+    j["pos"]["z"] = z;
+    p->deserialize(j);
+
+    return p;
+}
+
+/**
+ * Benchmarks encoding and decoding a whole tick worth of devices,
+ * reported per tick.
+ */
+static void benchTick(size_t count) {
+    std::vector<std::shared_ptr<Plane>> planes;
+    for (size_t i = 0; i < count; i++) {
+        planes.push_back(makePlane(i, i, i));
+    }
+
+    const std::string suffix = " x" + std::to_string(count);
+
+    bench("tick encode" + suffix, [&]() {
+        size_t bytes = 0;
+        for (auto& p : planes) {
+            ps::Buffer buf = ps::packet::device(p);
+            bytes += buf.size();
+            keep(buf);
+        }
+        ps::Buffer tick = ps::packet::tick();
+        keep(tick);
+        return bytes + tick.size();
+    });
+
+    std::vector<ps::Buffer> encoded;
+    for (auto& p : planes) {
+        encoded.push_back(ps::packet::device(p));
+    }
+
+    bench("tick decode" + suffix, [&]() {
+        size_t bytes = 0;
+        for (size_t i = 0; i < encoded.size(); i++) {
+            json j = ps::packet::decode(encoded[i].data(), encoded[i].size());
+            planes[i]->deserialize(j["d"]);
+            bytes += encoded[i].size();
+        }
+        return bytes;
+    });
+}
+
+int main(int argc, char** argv) {
+    benchmarks::allocationCounts = &allocations;
+
+    std::cout << std::left << std::setw(36) << "benchmark" << std::right
+              << std::setw(12) << "ns/op" << std::setw(12) << "bytes/op"
+              << std::setw(12) << "allocs/op" << std::endl;
+
+    benchControl("tick", []() { return ps::packet::tick(); });
+    benchControl("ready", []() { return ps::packet::ready(); });
+    benchControl("not_ready", []() { return ps::packet::not_ready(); });
+    benchControl("setup", []() { return ps::packet::setup(); });
+    benchControl("end", []() { return ps::packet::end(); });
+    benchControl("action", []() {
+        json params;
+        params["s"] = "hello";
+        params["n"] = 42;
+        return ps::packet::action("hello_world", params);
+    });
+
+    auto plane = makePlane(1, 2, 3);
+    benchControl("deviceAdd", [&]() { return ps::packet::deviceAdd(plane); });
+    benchDevice("plane", plane);
+
+    benchDevice("flat", std::make_shared<ShapeDevice>(ShapeDevice::FLAT));
+    benchDevice("wide", std::make_shared<ShapeDevice>(ShapeDevice::WIDE));
+    benchDevice("array", std::make_shared<ShapeDevice>(ShapeDevice::ARRAY));
+    benchDevice("binary", std::make_shared<ShapeDevice>(ShapeDevice::BINARY));
+    benchDevice("text", std::make_shared<ShapeDevice>(ShapeDevice::TEXT));
+
+    const std::vector<size_t> counts = {1, 100, 10000};
+    for (size_t count : counts) {
+        benchTick(count);
+    }
+
+    return 0;
+}
@@ -0,0 +1,234 @@
+
+#ifndef PAIRSIM_BENCH_HPP_
+#define PAIRSIM_BENCH_HPP_
+
+/**
+ * Helpers shared by the benchmarks: a test device with its models,
+ * --name=value parsing, a runner for an in-process pair and, when
+ * PAIRSIM_BENCH_ALLOCATIONS is defined before including this header, an
+ * allocation counting operator new. Each benchmark is a single
+ * translation unit, which the replaced operator new relies on.
+ */
+
+// Standard lib utilities
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <time.h>
+
+#include <pairsim/server.hpp>
+#include <pairsim/client.hpp>
+
+#ifdef PAIRSIM_BENCH_ALLOCATIONS
+// GCC can't tell that the replaced operator new below pairs with free()
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 11
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+namespace benchmarks {
+
+/**
+ * Allocations counted on a thread.
+ */
+struct AllocationCounts {
+    size_t count = 0;
+    size_t bytes = 0;
+};
+
+/** Where this thread's allocations are counted, if anywhere. */
+static thread_local AllocationCounts* allocationCounts = nullptr;
+
+}
+
+void* operator new(std::size_t size) {
+    if (benchmarks::allocationCounts != nullptr) {
+        benchmarks::allocationCounts->count++;
+        benchmarks::allocationCounts->bytes += size;
+    }
+    void* p = std::malloc(size ? size : 1);
+    if (p == nullptr) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept {
+    std::free(p);
+}
+#endif
+
+namespace benchmarks {
+
+/**
+ * Device with a position, close to what the example planes send.
+ */
+class PointDevice : public ps::Device {
+private:
+    double x;
+    double y;
+    double z;
+
+public:
+    PointDevice() : ps::Device{"point"}, x{0}, y{0}, z{0} {}
+
+    void move() {
+        x += 1;
+        y += 0.5;
+        z += 0.25;
+    }
+
+    json serialize() {
+        json j;
+        j["x"] = x;
+        j["y"] = y;
+        j["z"] = z;
+        return j;
+    }
+
+    void deserialize(json j) {
+        x = j["x"].get<double>();
+        y = j["y"].get<double>();
+        z = j["z"].get<double>();
+    }
+
+    bool copyFrom(ps::Device& other) {
+        PointDevice& d = static_cast<PointDevice&>(other);
+        x = d.x;
+        y = d.y;
+        z = d.z;
+        return true;
+    }
+
+    bool getPosition(ps::Position& pos) {
+        pos = ps::Position{x, y, z};
+        return true;
+    }
+
+    std::size_t memoryUsage() {
+        return sizeof(PointDevice) - sizeof(ps::Device) + ps::Device::memoryUsage();
+    }
+};
+
+/**
+ * Client adding some PointDevices on setup and moving them every step.
+ */
+class PointClientModel : public ps::ClientModel<> {
+private:
+    size_t count;
+    std::vector<std::shared_ptr<PointDevice>> devices;
+
+public:
+    PointClientModel(size_t _count) : count{_count} {}
+
+    void setup(ps::Client<>* client) {
+        for (size_t i = 0; i < count; i++) {
+            auto d = std::make_shared<PointDevice>();
+            devices.push_back(d);
+            client->addDevice(d);
+        }
+    }
+
+    void step(ps::Client<>* client) {
+        for (auto& d : devices) {
+            d->move();
+        }
+    }
+
+    void end() {
+        // no-op
+    }
+};
+
+/**
+ * Server mirroring the client's PointDevices.
+ */
+class PointServerModel : public ps::ServerModel<> {
+public:
+    std::shared_ptr<ps::Device> onDeviceAdd(std::string deviceType, std::uint32_t id) {
+        return std::make_shared<PointDevice>();
+    }
+
+    void setup(ps::Server<>* server) {
+        // no-op
+    }
+
+    void step(ps::Server<>* server) {
+        // no-op
+    }
+
+    void end() {
+        // no-op
+    }
+};
+
+/**
+ * Splits --name=value arguments.
+ * \param args Values by name.
+ * \returns `false` if an argument isn't of that form.
+ */
+inline bool parseArgs(int argc, char** argv, std::map<std::string, std::string>& args) {
+    for (int i = 1; i < argc; i++) {
+        const char* eq = std::strchr(argv[i], '=');
+        if (std::strncmp(argv[i], "--", 2) != 0 || eq == nullptr) {
+            return false;
+        }
+        args[std::string(argv[i] + 2, eq - argv[i] - 2)] = eq + 1;
+    }
+    return true;
+}
+
+/**
+ * Runs a pair in this process: the server on a thread of its own and,
+ * once it listens, the client on the calling thread.
+ * \param server Sets up and runs the server until the session ends.
+ * \param client Sets up, runs and ends the client.
+ */
+template <typename ServerFn, typename ClientFn>
+void runPair(ServerFn server, ClientFn client) {
+    std::thread serverThread(server);
+    // gives the listener time to come up, as NNG dials synchronously
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+    client();
+    serverThread.join();
+}
+
+/**
+ * Gets the CPU time of the calling thread.
+ * \returns CPU time, in us.
+ */
+inline double threadCpuUs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+/**
+ * Gets a percentile of sorted samples.
+ * \param sorted Samples, in ascending order.
+ * \param p Percentile, from 0 to 1.
+ * \returns Sample, 0 without samples.
+ */
+inline double percentile(const std::vector<double>& sorted, double p) {
+    if (sorted.empty()) {
+        return 0;
+    }
+    const size_t i = std::min(sorted.size() - 1, (size_t) (p * sorted.size()));
+    return sorted[i];
+}
+
+}
+
+#endif // PAIRSIM_BENCH_HPP_
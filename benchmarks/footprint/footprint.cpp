@@ -0,0 +1,142 @@
+#include <future>
+#include <iostream>
+#include <iomanip>
+#include <map>
+#include <string>
+
+#include <malloc.h>
+
+#include "../common/bench.hpp"
+
+/**
+ * Benchmark settings, all overridable with --name=value.
+ */
+struct Config {
+    std::string address = "local://footprint";
+
+    /** Device counts to measure, comma separated. */
+    std::string devices = "1000,10000,100000";
+
+    /** Ticks run before measuring, at least 1. */
+    size_t ticks = 10;
+};
+
+/**
+ * Bytes currently allocated from the heap by the whole process.
+ */
+static size_t heapInUse() {
+    return mallinfo2().uordblks;
+}
+
+/**
+ * Prints a node's footprint next to its bytes per device.
+ */
+static void report(const std::string& side, const ps::MemoryFootprint& f, size_t devices) {
+    std::cout << side << ": " << f.total() << " B, " << std::fixed << std::setprecision(1)
+              << (double) f.total() / devices << " B/device" << std::endl;
+    f.report(std::cout);
+}
+
+/**
+ * Sets up a pair with some devices, runs a few ticks and reports both
+ * sides' footprints, checked against the heap growth of the process.
+ */
+static void measure(const Config& config, size_t devices) {
+    const size_t heapBefore = heapInUse();
+
+    ps::Server<> server;
+    ps::Client<> client;
+    ps::MemoryFootprint serverFootprint, clientFootprint;
+    std::promise<void> serverMeasured;
+    size_t heapDuring = 0;
+
+    server.setServerAddr(config.address);
+    server.setModel(std::make_shared<benchmarks::PointServerModel>());
+    client.setServerAddr(config.address);
+    client.setModel(std::make_shared<benchmarks::PointClientModel>(devices));
+
+    benchmarks::runPair([&]() {
+        server.setup();
+        for (size_t tick = 1;; tick++) {
+            server.waitTick();
+            if (server.shouldEnd()) {
+                break;
+            }
+            server.getData();
+            server.sendData();
+
+            // read on the server's own thread, once its last measured
+            // tick is out
+            if (tick == config.ticks) {
+                serverFootprint = server.memoryFootprint();
+                serverMeasured.set_value();
+            }
+        }
+    }, [&]() {
+        client.setup();
+        for (size_t i = 0; i < config.ticks; i++) {
+            client.tick();
+        }
+        clientFootprint = client.memoryFootprint();
+
+        // the server then blocks waiting for a TICK that only comes
+        // with the END, so the heap holds still
+        serverMeasured.get_future().wait();
+        heapDuring = heapInUse();
+
+        client.end();
+    });
+
+    std::cout << "== " << devices << " devices" << std::endl;
+    report("client", clientFootprint, devices);
+    report("server", serverFootprint, devices);
+
+    // the estimates leave out allocator overhead, the models' own device
+    // lists and transport buffers, all part of the measured growth
+    const size_t estimated = clientFootprint.total() + serverFootprint.total();
+    const size_t measured = heapDuring - heapBefore;
+    std::cout << "estimated heap (both) " << estimated << " B, " << (double) estimated / devices << " B/device"
+              << std::endl
+              << "measured heap (both)  " << measured << " B, " << (double) measured / devices << " B/device"
+              << std::endl << std::endl;
+}
+
+static bool parse(int argc, char** argv, Config& config) {
+    std::map<std::string, std::string> args;
+    if (!benchmarks::parseArgs(argc, argv, args)) {
+        return false;
+    }
+
+    for (const auto& arg : args) {
+        const std::string& k = arg.first;
+        const std::string& v = arg.second;
+
+        if (k == "address") config.address = v;
+        else if (k == "devices") config.devices = v;
+        else if (k == "ticks") config.ticks = std::stoul(v);
+        else return false;
+    }
+
+    return config.ticks > 0;
+}
+
+int main(int argc, char** argv) {
+    Config config;
+    if (!parse(argc, argv, config)) {
+        std::cerr << "usage: " << argv[0] << " [--address=local://footprint] [--devices=1000,10000,100000]"
+                  << " [--ticks=10]" << std::endl;
+        return 1;
+    }
+
+    size_t start = 0;
+    while (start < config.devices.size()) {
+        size_t end = config.devices.find(',', start);
+        if (end == std::string::npos) {
+            end = config.devices.size();
+        }
+        measure(config, std::stoul(config.devices.substr(start, end - start)));
+        start = end + 1;
+    }
+
+    return 0;
+}
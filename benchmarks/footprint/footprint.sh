@@ -0,0 +1 @@
+g++ footprint.cpp -o footprint -std=c++17 -O2 -lpthread -lnng -I../../include -I../../examples/omnet_module/src/include -Wall
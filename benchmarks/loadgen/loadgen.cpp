@@ -0,0 +1,429 @@
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <iomanip>
+#include <limits>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../common/bench.hpp"
+
+/**
+ * Load generator settings, all overridable with --name=value.
+ */
+struct Config {
+    /** "both" runs a server and a client in this process, "client" or
+     * "server" only one side, to pair with another loadgen process. */
+    std::string role = "both";
+    std::string address = "tcp://127.0.0.1:4201";
+
+    /** Devices the client adds during setup. */
+    size_t devices = 1000;
+
+    /** Opaque payload bytes each device carries besides its position. */
+    size_t payload = 64;
+
+    /** Actions the client sends per tick. */
+    size_t actions = 0;
+
+    /** Devices added (and as many retired) per tick. */
+    size_t churn = 0;
+
+    /** Most devices churn may create, 0 for twice `devices`. Past it,
+     * retired devices are revived instead of adding new ones. */
+    size_t maxDevices = 0;
+
+    /** Client ticks per second, 0 for as fast as possible. */
+    double rate = 0;
+
+    /** Update period of the server's copies, 1 to echo every tick. */
+    size_t serverPeriod = 1;
+
+    size_t ticks = 1000;
+    size_t warmup = 100;
+};
+
+/**
+ * Counters shared by the devices of one side.
+ */
+struct Counters {
+    size_t serialized = 0;
+    size_t deserialized = 0;
+    size_t actions = 0;
+
+    /** Devices churn added and revived. */
+    size_t added = 0;
+    size_t revived = 0;
+};
+
+/**
+ * Device with a position and an opaque payload of configurable size.
+ */
+class LoadDevice : public ps::Device {
+private:
+    double x;
+    double y;
+    double z;
+    std::vector<std::uint8_t> payload;
+    Counters* counters;
+
+public:
+    LoadDevice(size_t payloadSize, Counters* _counters)
+        : ps::Device{"load"}, x{0}, y{0}, z{0}, payload(payloadSize, 0), counters{_counters} {}
+
+    void move() {
+        x += 1;
+        y += 0.5;
+        z += 0.25;
+        if (!payload.empty()) {
+            payload[(size_t) x % payload.size()]++;
+        }
+    }
+
+    json serialize() {
+        counters->serialized++;
+
+        json j;
+        j["x"] = x;
+        j["y"] = y;
+        j["z"] = z;
+        if (!payload.empty()) {
+            j["p"] = json::binary(payload);
+        }
+        return j;
+    }
+
+    void deserialize(json j) {
+        counters->deserialized++;
+
+        x = j["x"].get<double>();
+        y = j["y"].get<double>();
+        z = j["z"].get<double>();
+        if (j.contains("p")) {
+            payload = j["p"].get_binary();
+        }
+    }
+
+    bool copyFrom(ps::Device& other) {
+        counters->deserialized++;
+
+        LoadDevice& d = static_cast<LoadDevice&>(other);
+        x = d.x;
+        y = d.y;
+        z = d.z;
+        payload = d.payload;
+        return true;
+    }
+
+    bool getPosition(ps::Position& pos) {
+        pos = ps::Position{x, y, z};
+        return true;
+    }
+};
+
+class LoadClientModel : public ps::ClientModel<> {
+private:
+    const Config& config;
+    Counters& counters;
+    std::vector<std::shared_ptr<LoadDevice>> devices;
+
+    /** Devices retired so far; the active ones follow it, modulo the
+     * device count once it reaches the cap. */
+    size_t retired;
+
+public:
+    LoadClientModel(const Config& _config, Counters& _counters)
+        : config{_config}, counters{_counters}, retired{0} {}
+
+    void setup(ps::Client<>* client) {
+        for (size_t i = 0; i < config.devices; i++) {
+            add(client);
+        }
+    }
+
+    void step(ps::Client<>* client) {
+        // the protocol has no device removal, so churn is simulated:
+        // retired devices only go quiet, and past the cap the longest
+        // retired are revived rather than letting the device set grow
+        for (size_t i = 0; i < config.churn && !devices.empty(); i++) {
+            devices[retired % devices.size()]->setUpdatePeriod(std::numeric_limits<std::uint32_t>::max());
+            if (devices.size() < config.maxDevices) {
+                add(client);
+                counters.added++;
+            }
+            else {
+                devices[(retired + config.devices) % devices.size()]->setUpdatePeriod(1);
+                counters.revived++;
+            }
+            retired++;
+        }
+
+        for (size_t i = 0; i < config.devices && !devices.empty(); i++) {
+            devices[(retired + i) % devices.size()]->move();
+        }
+
+        for (size_t i = 0; i < config.actions; i++) {
+            json params;
+            params["i"] = i;
+            client->sendAction("load", params);
+        }
+    }
+
+    void end() {
+        // no-op
+    }
+
+private:
+    void add(ps::Client<>* client) {
+        auto d = std::make_shared<LoadDevice>(config.payload, &counters);
+        devices.push_back(d);
+        client->addDevice(d);
+    }
+};
+
+class LoadServerModel : public ps::ServerModel<> {
+private:
+    const Config& config;
+    Counters& counters;
+
+public:
+    LoadServerModel(const Config& _config, Counters& _counters) : config{_config}, counters{_counters} {}
+
+    std::shared_ptr<ps::Device> onDeviceAdd(std::string deviceType, std::uint32_t id) {
+        auto d = std::make_shared<LoadDevice>(config.payload, &counters);
+        d->setUpdatePeriod(config.serverPeriod);
+        return d;
+    }
+
+    void setup(ps::Server<>* server) {
+        server->addAction("load", [this](json params) {
+            counters.actions++;
+        });
+    }
+
+    void step(ps::Server<>* server) {
+        // no-op
+    }
+
+    void end() {
+        // no-op
+    }
+};
+
+/**
+ * Measurements of one side.
+ */
+struct SideStats {
+    /** Per tick latency, in us. */
+    std::vector<double> latencies;
+
+    double cpuUs = 0;
+    double wallS = 0;
+    size_t ticks = 0;
+
+    /** Where lockstep time went, as this side saw it. */
+    ps::AttributionSummary attribution{};
+};
+
+static void report(const std::string& side, SideStats& s, const Counters& c, const Config& config) {
+    std::cout << side << ":" << std::endl;
+    if (s.ticks == 0) {
+        std::cout << "  no ticks measured past the warmup" << std::endl;
+        return;
+    }
+
+    std::sort(s.latencies.begin(), s.latencies.end());
+    const double ticks = s.ticks;
+
+    std::cout << std::fixed << std::setprecision(2)
+              << "  ticks/s       " << s.ticks / s.wallS << std::endl
+              << "  updates/s     " << c.serialized / s.wallS << " sent, "
+                                    << c.deserialized / s.wallS << " received" << std::endl
+              << "  payload MB/s  " << c.serialized * config.payload / s.wallS / 1e6 << " sent" << std::endl
+              << "  actions/s     " << c.actions / s.wallS << " received" << std::endl
+              << "  cpu/tick (us) " << s.cpuUs / ticks << std::endl;
+    if (c.added + c.revived > 0) {
+        std::cout << "  churn         " << c.added << " added, " << c.revived
+                  << " revived (simulated, retired devices only go quiet)" << std::endl;
+    }
+    std::cout
+              << "  latency (us)  p50 " << benchmarks::percentile(s.latencies, 0.5)
+              << "  p90 " << benchmarks::percentile(s.latencies, 0.9)
+              << "  p99 " << benchmarks::percentile(s.latencies, 0.99)
+              << "  p99.9 " << benchmarks::percentile(s.latencies, 0.999)
+              << "  max " << (s.latencies.empty() ? 0 : s.latencies.back()) << std::endl;
+
+    if (s.attribution.ticks > 0) {
+        const ps::AttributionSummary& a = s.attribution;
+        std::cout << std::setprecision(1)
+                  << "  lockstep (%)  client " << a.share(ps::TickAttribution::CLIENT) * 100
+                  << "  server " << a.share(ps::TickAttribution::SERVER) * 100
+                  << "  network " << a.share(ps::TickAttribution::NETWORK) * 100 << std::endl
+                  << "  bottleneck    client " << a.bottlenecks[ps::TickAttribution::CLIENT]
+                  << "  server " << a.bottlenecks[ps::TickAttribution::SERVER]
+                  << "  network " << a.bottlenecks[ps::TickAttribution::NETWORK] << " ticks" << std::endl;
+    }
+}
+
+/**
+ * Runs a server until the client ends the session. Latency is the time
+ * it takes to serve a tick, from the client's TICK to its own.
+ */
+static void runServer(const Config& config, SideStats& stats, Counters& counters) {
+    ps::Server<> server;
+    server.setServerAddr(config.address);
+    server.setModel(std::make_shared<LoadServerModel>(config, counters));
+    server.setWaitAttribution(true);
+    server.setup();
+
+    size_t tick = 0;
+    double cpuStart = benchmarks::threadCpuUs();
+    auto wallStart = std::chrono::steady_clock::now();
+
+    for (;;) {
+        server.waitTick();
+        if (server.shouldEnd()) {
+            break;
+        }
+
+        if (++tick == config.warmup + 1) {
+            cpuStart = benchmarks::threadCpuUs();
+            wallStart = std::chrono::steady_clock::now();
+            counters = Counters{};
+            server.resetAttributionSummary();
+        }
+
+        const auto start = std::chrono::steady_clock::now();
+        server.getData();
+        server.sendData();
+
+        if (tick > config.warmup) {
+            stats.latencies.push_back(std::chrono::duration<double, std::micro>(
+                std::chrono::steady_clock::now() - start).count());
+        }
+    }
+
+    stats.cpuUs = benchmarks::threadCpuUs() - cpuStart;
+    stats.wallS = std::chrono::duration<double>(std::chrono::steady_clock::now() - wallStart).count();
+    stats.ticks = stats.latencies.size();
+    stats.attribution = server.getAttributionSummary();
+}
+
+/**
+ * Runs a client for the configured ticks. Latency is a whole tick:
+ * step, send, and wait for the server's TICK.
+ */
+static void runClient(const Config& config, SideStats& stats, Counters& counters) {
+    ps::Client<> client;
+    client.setServerAddr(config.address);
+    client.setRetryDelay(std::chrono::milliseconds(100));
+    client.setModel(std::make_shared<LoadClientModel>(config, counters));
+    client.setWaitAttribution(true);
+    client.setup();
+
+    for (size_t i = 0; i < config.warmup; i++) {
+        client.tick();
+    }
+    counters = Counters{};
+    client.resetAttributionSummary();
+
+    const auto period = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+        std::chrono::duration<double>(config.rate > 0 ? 1 / config.rate : 0));
+
+    const double cpuStart = benchmarks::threadCpuUs();
+    const auto wallStart = std::chrono::steady_clock::now();
+    auto next = wallStart;
+
+    for (size_t i = 0; i < config.ticks; i++) {
+        if (config.rate > 0) {
+            std::this_thread::sleep_until(next);
+            next += period;
+        }
+
+        const auto start = std::chrono::steady_clock::now();
+        client.tick();
+        stats.latencies.push_back(std::chrono::duration<double, std::micro>(
+            std::chrono::steady_clock::now() - start).count());
+    }
+
+    stats.cpuUs = benchmarks::threadCpuUs() - cpuStart;
+    stats.wallS = std::chrono::duration<double>(std::chrono::steady_clock::now() - wallStart).count();
+    stats.ticks = config.ticks;
+    stats.attribution = client.getAttributionSummary();
+
+    client.end();
+}
+
+static bool parse(int argc, char** argv, Config& config) {
+    std::map<std::string, std::string> args;
+    if (!benchmarks::parseArgs(argc, argv, args)) {
+        return false;
+    }
+
+    for (const auto& arg : args) {
+        const std::string& k = arg.first;
+        const std::string& v = arg.second;
+
+        if (k == "role") config.role = v;
+        else if (k == "address") config.address = v;
+        else if (k == "devices") config.devices = std::stoul(v);
+        else if (k == "payload") config.payload = std::stoul(v);
+        else if (k == "actions") config.actions = std::stoul(v);
+        else if (k == "churn") config.churn = std::stoul(v);
+        else if (k == "max-devices") config.maxDevices = std::stoul(v);
+        else if (k == "rate") config.rate = std::stod(v);
+        else if (k == "server-period") config.serverPeriod = std::stoul(v);
+        else if (k == "ticks") config.ticks = std::stoul(v);
+        else if (k == "warmup") config.warmup = std::stoul(v);
+        else return false;
+    }
+
+    if (config.maxDevices == 0) {
+        config.maxDevices = 2 * config.devices;
+    }
+    config.maxDevices = std::max(config.maxDevices, config.devices + config.churn);
+
+    return config.role == "both" || config.role == "client" || config.role == "server";
+}
+
+int main(int argc, char** argv) {
+    Config config;
+    if (!parse(argc, argv, config)) {
+        std::cerr << "usage: " << argv[0] << " [--role=both|client|server] [--address=tcp://127.0.0.1:4201]" << std::endl
+                  << "    [--devices=1000] [--payload=64] [--actions=0] [--churn=0] [--max-devices=0]" << std::endl
+                  << "    [--rate=0] [--server-period=1] [--ticks=1000] [--warmup=100]" << std::endl;
+        return 1;
+    }
+
+    std::cout << config.role << " on " << config.address << ": " << config.devices << " devices, "
+              << config.payload << " B payload, " << config.actions << " actions/tick, "
+              << config.churn << " churn/tick (up to " << config.maxDevices << " devices), " << (config.rate > 0 ? std::to_string(config.rate) : "max")
+              << " ticks/s" << std::endl;
+
+    SideStats serverStats, clientStats;
+    Counters serverCounters, clientCounters;
+
+    if (config.role == "server") {
+        runServer(config, serverStats, serverCounters);
+        report("server", serverStats, serverCounters, config);
+        return 0;
+    }
+
+    if (config.role == "client") {
+        runClient(config, clientStats, clientCounters);
+        report("client", clientStats, clientCounters, config);
+        return 0;
+    }
+
+    benchmarks::runPair([&]() {
+        runServer(config, serverStats, serverCounters);
+    }, [&]() {
+        runClient(config, clientStats, clientCounters);
+    });
+    report("client", clientStats, clientCounters, config);
+    report("server", serverStats, serverCounters, config);
+
+    return 0;
+}
@@ -0,0 +1,137 @@
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+
+#include "../common/bench.hpp"
+
+struct Result {
+    double p50Us;
+    double p99Us;
+    double p999Us;
+    double ticksPerSecond;
+    double clientCpuUs;
+    double serverCpuUs;
+};
+
+/**
+ * Runs a client and a server on two threads of this process and times
+ * full client ticks (step, send, wait for the server's TICK).
+ */
+static Result run(const std::string& address, size_t ticks, size_t warmup, size_t devices) {
+    double serverCpuUs = 0;
+    std::vector<double> rtts;
+    double clientCpuUs = 0;
+    double wallS = 0;
+
+    benchmarks::runPair([&]() {
+        ps::Server<> server;
+        server.setServerAddr(address);
+        server.setModel(std::make_shared<benchmarks::PointServerModel>());
+        server.setup();
+
+        double start = 0;
+        size_t tick = 0;
+        for (;;) {
+            server.waitTick();
+            if (server.shouldEnd()) {
+                break;
+            }
+            if (++tick == warmup) {
+                start = benchmarks::threadCpuUs();
+            }
+            server.getData();
+            server.sendData();
+        }
+        serverCpuUs = (benchmarks::threadCpuUs() - start) / ticks;
+    }, [&]() {
+        ps::Client<> client;
+        client.setServerAddr(address);
+        client.setModel(std::make_shared<benchmarks::PointClientModel>(devices));
+        client.setup();
+
+        for (size_t i = 0; i < warmup; i++) {
+            client.tick();
+        }
+
+        rtts.reserve(ticks);
+
+        const double cpuStart = benchmarks::threadCpuUs();
+        const auto wallStart = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < ticks; i++) {
+            const auto tickStart = std::chrono::steady_clock::now();
+            client.tick();
+            rtts.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - tickStart).count());
+        }
+        wallS = std::chrono::duration<double>(std::chrono::steady_clock::now() - wallStart).count();
+        clientCpuUs = (benchmarks::threadCpuUs() - cpuStart) / ticks;
+
+        client.end();
+    });
+
+    std::sort(rtts.begin(), rtts.end());
+
+    Result r;
+    r.p50Us = benchmarks::percentile(rtts, 0.5);
+    r.p99Us = benchmarks::percentile(rtts, 0.99);
+    r.p999Us = benchmarks::percentile(rtts, 0.999);
+    r.ticksPerSecond = ticks / wallS;
+    r.clientCpuUs = clientCpuUs;
+    r.serverCpuUs = serverCpuUs;
+    return r;
+}
+
+int main(int argc, char** argv) {
+    const size_t ticks = argc > 1 ? std::atoi(argv[1]) : 10000;
+    const size_t devices = argc > 2 ? std::atoi(argv[2]) : 5;
+    const std::string only = argc > 3 ? argv[3] : "";
+    const size_t warmup = ticks / 10 + 1;
+
+    if (ticks == 0) {
+        std::cerr << "usage: " << argv[0] << " [ticks] [devices] [address prefix]" << std::endl;
+        return 1;
+    }
+
+    const std::vector<std::string> addresses = {
+        "inproc://pairsim-loopback",
+        "ipc:///tmp/pairsim-loopback.ipc",
+        "tcp://127.0.0.1:4101",
+#ifdef PAIRSIM_URING_ENABLED
+        "uring+tcp://127.0.0.1:4102",
+#endif
+#ifdef __linux__
+        "shm://pairsim-loopback",
+#endif
+        "local://loopback",
+    };
+
+    std::cout << ticks << " ticks, " << devices << " devices" << std::endl;
+    std::cout << std::left << std::setw(34) << "address" << std::right
+              << std::setw(12) << "p50 (us)"
+              << std::setw(12) << "p99 (us)"
+              << std::setw(12) << "p999 (us)"
+              << std::setw(12) << "ticks/s"
+              << std::setw(18) << "client cpu (us)"
+              << std::setw(18) << "server cpu (us)" << std::endl;
+
+    for (const auto& address : addresses) {
+        if (address.rfind(only, 0) != 0) {
+            continue;
+        }
+
+        const Result r = run(address, ticks, warmup, devices);
+        std::cout << std::left << std::setw(34) << address << std::right << std::fixed << std::setprecision(2)
+                  << std::setw(12) << r.p50Us
+                  << std::setw(12) << r.p99Us
+                  << std::setw(12) << r.p999Us
+                  << std::setprecision(0) << std::setw(12) << r.ticksPerSecond
+                  << std::setprecision(2) << std::setw(18) << r.clientCpuUs
+                  << std::setw(18) << r.serverCpuUs << std::endl;
+    }
+
+    return 0;
+}
@@ -0,0 +1 @@
+g++ loopback.cpp -o loopback -std=c++17 -O2 -DPAIRSIM_URING_ENABLED -lpthread -lnng -I../../include -I../../examples/omnet_module/src/include -Wall
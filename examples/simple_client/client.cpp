@@ -18,13 +18,14 @@ int main() {
     std::signal(SIGINT, sigintHandler);
 
     auto tickDuration = std::chrono::seconds(1);
+    client.setTickDuration(tickDuration);
     client.setServerAddr("tcp://127.0.0.1:4001");
     client.setModel(std::make_shared<TestClientModel>());
 
     client.setup();
 
     while (!client.shouldEnd()) {
-        std::this_thread::sleep_for(tickDuration);
+        client.pace();
         client.tick();
     }
 
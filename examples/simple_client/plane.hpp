@@ -38,6 +38,24 @@ public:
         y = pos["y"].get<float>();
         z = pos["z"].get<float>();
     }
+
+    bool getPosition(ps::Position& pos) {
+        pos = ps::Position{x, y, z};
+        return true;
+    }
+
+    bool copyFrom(ps::Device& other) {
+        Plane* p = dynamic_cast<Plane*>(&other);
+        if (p == nullptr) {
+            return false;
+        }
+
+        x = p->x;
+        y = p->y;
+        z = p->z;
+
+        return true;
+    }
 };
 
 #endif // PLANE_HPP_
@@ -21,6 +21,7 @@ int main() {
     std::signal(SIGINT, sigintHandler);
 
     auto tickDuration = std::chrono::seconds(1);
+    server.setTickDuration(tickDuration);
     server.setServerAddr("tcp://127.0.0.1:4001");
     server.setModel(std::make_shared<TestServerModel>());
 
@@ -29,7 +30,7 @@ int main() {
     while (!server.shouldEnd()) {
         server.waitTick();
         // other tasks would be here
-        std::this_thread::sleep_for(tickDuration);
+        server.pace();
         server.sendData();
     }
 
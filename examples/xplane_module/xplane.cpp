@@ -6,8 +6,11 @@
 #include "XPLMMock.h"
 #endif
 
+#include <algorithm>
+#include <atomic>
 #include <cstring>
 #include <cfloat>
+#include <cmath>
 
 #include <pairsim/server_model.hpp>
 
@@ -25,6 +28,11 @@
 using duration_t = double;
 using AvensServer = ps::Server<duration_t>;
 
+// sim/time/sim_speed only takes whole factors, up to 16x
+static constexpr int MAX_EXECUTION_SPEED = 16;
+// set by the node's thread on REAL_TIME_FACTOR, read by the flight loop
+static std::atomic<int> executionSpeed{1};
+
 class UserPlane : public ps::Device {
 private:
     double x;
@@ -65,6 +73,12 @@ public:
     void deserialize(json j) {
         // no-op
     }
+
+    bool getPosition(ps::Position& pos) {
+        getData();
+        pos = ps::Position{x, y, z};
+        return true;
+    }
 };
 
 class XPlaneModel : public ps::ServerModel<duration_t> {
@@ -103,6 +117,11 @@ public:
         // no-op
     }
 
+    void onRealTimeFactor(double factor) {
+        executionSpeed.store(factor > 0 ? std::max(1, std::min(MAX_EXECUTION_SPEED, (int) std::lround(factor)))
+                                        : MAX_EXECUTION_SPEED);
+    }
+
     bool ready() {
         return *isReady;
     }
@@ -111,19 +130,20 @@ public:
 static AvensServer* server = nullptr;
 static bool flightReady = false;
 static bool paused = false;
-static bool shouldPause = true;
+
+// when the flight loop pauses X-Plane again, on the server's clock
+static ps::Clock::time_point pauseDeadline;
 static XPLMDataRef timeSpeedRef;
-static constexpr uint8_t EXECUTION_SPEED = 1;
 
-void pause() {
+void pauseSim() {
     std::cout << "paused" << std::endl;
     XPLMSetDatai(timeSpeedRef, 0);
     paused = true;
 }
 
-void unpause() {
+void unpauseSim(int speed) {
     std::cout << "unpaused" << std::endl;
-    XPLMSetDatai(timeSpeedRef, EXECUTION_SPEED);
+    XPLMSetDatai(timeSpeedRef, speed);
     paused = false;
 }
 
@@ -135,19 +155,23 @@ float serverCallback(float inElapsedSinceLastCall, float inElapsedTimeSinceLastF
 
     flightReady = true; // maybe this could be in the message callback, whenever a plane is loaded
 
+    ps::Clock& clock = server->getClock();
+    if (clock.isVirtual()) {
+        // nothing else moves a virtual clock here, so X-Plane's flight loop does
+        clock.sleepFor(std::chrono::duration<double>(inElapsedSinceLastCall));
+    }
+
     if (server->getState() == AvensServer::State::SHOULD_GET_DATA) {
         if (paused) {
-            unpause();
-            shouldPause = false;
-
-            std::thread thr([]() {
-                std::this_thread::sleep_for(std::chrono::microseconds(static_cast<long long>(server->getTickDuration() * 1000000)));
-                shouldPause = true;
-            });
-            thr.detach();
+            // latched so that the speed and the deadline match for the whole tick
+            const int speed = executionSpeed.load();
+            unpauseSim(speed);
+            // a tick of simulated time, at the agreed speed
+            pauseDeadline = clock.now() + std::chrono::duration_cast<ps::Clock::time_point::duration>(
+                std::chrono::duration<double>(server->getTickDuration() / speed));
         }
-        else if (shouldPause) {
-            pause();
+        else if (clock.now() >= pauseDeadline) {
+            pauseSim();
             server->getData();
             
             std::thread thr([]() {
@@ -156,6 +180,13 @@ float serverCallback(float inElapsedSinceLastCall, float inElapsedTimeSinceLastF
             });
             thr.detach();
         }
+
+        if (!paused) {
+            // called back when this tick of simulated time is over, or on the
+            // next frame if it already is
+            const std::chrono::duration<double> left = pauseDeadline - clock.now();
+            return left.count() > 0 ? (float) left.count() : -1.0f;
+        }
     }
 
     return server->getTickDuration();
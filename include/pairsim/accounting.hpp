@@ -0,0 +1,201 @@
+
+#ifndef PAIRSIM_ACCOUNTING_HPP_
+#define PAIRSIM_ACCOUNTING_HPP_
+
+// Standard lib utilities
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <map>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Internal classes
+#include "footprint.hpp"
+#include "packet_type.hpp"
+
+namespace ps {
+
+/**
+ * Traffic of one packet type or device type.
+ */
+struct TrafficCounts {
+    /** Messages and encoded bytes sent. Devices handed over in memory add
+     * no bytes. */
+    std::uint64_t sent;
+    std::uint64_t sentBytes;
+
+    /** Time spent serializing and encoding, in ns. */
+    std::uint64_t encodeTime;
+
+    /** Messages and encoded bytes received. */
+    std::uint64_t received;
+    std::uint64_t receivedBytes;
+
+    /** Time spent decoding and deserializing, in ns. */
+    std::uint64_t decodeTime;
+
+    /**
+     * Gets the messages sent and received.
+     * \returns Message count.
+     */
+    std::uint64_t messages() const {
+        return sent + received;
+    }
+
+    /**
+     * Gets the bytes sent and received.
+     * \returns Byte count.
+     */
+    std::uint64_t bytes() const {
+        return sentBytes + receivedBytes;
+    }
+
+    /**
+     * Gets the time spent encoding and decoding.
+     * \returns Time, in ns.
+     */
+    std::uint64_t time() const {
+        return encodeTime + decodeTime;
+    }
+};
+
+/**
+ * Traffic by packet type and by device type, see Node::setTrafficAccounting.
+ * Only read it from the node's thread.
+ */
+class TrafficAccounting {
+public:
+    /** What top() ranks by. */
+    enum Order {
+        BY_BYTES = 0,
+        BY_MESSAGES = 1,
+        BY_TIME = 2,
+    };
+
+    /** A ranked entry, named after its packet or device type. */
+    using Entry = std::pair<std::string, TrafficCounts>;
+
+private:
+    TrafficCounts packetTypes[256];
+    std::map<std::string, TrafficCounts> deviceTypes;
+
+public:
+    TrafficAccounting() : packetTypes{} {}
+
+    /**
+     * Gets the counts of a packet type, for updating.
+     * \param type Packet type.
+     * \returns Counts.
+     */
+    TrafficCounts& packet(PacketType type) {
+        return packetTypes[type];
+    }
+
+    /**
+     * Gets the counts of a device type, for updating.
+     * \param deviceType Device type.
+     * \returns Counts, created zeroed on first use.
+     */
+    TrafficCounts& device(const std::string& deviceType) {
+        return deviceTypes[deviceType];
+    }
+
+    /**
+     * Ranks the packet types.
+     * \param n Maximum number of entries, 0 for all.
+     * \param by What to rank by.
+     * \returns Entries seen so far, largest first.
+     */
+    std::vector<Entry> topPacketTypes(std::size_t n, Order by=BY_BYTES) const {
+        std::vector<Entry> entries;
+        for (PacketType type : PACKET_TYPES) {
+            if (packetTypes[type].messages() > 0) {
+                entries.emplace_back(packetName(type), packetTypes[type]);
+            }
+        }
+        return rank(std::move(entries), n, by);
+    }
+
+    /**
+     * Ranks the device types, e.g. to find which devices' serialize() to
+     * optimize first.
+     * \param n Maximum number of entries, 0 for all.
+     * \param by What to rank by.
+     * \returns Entries seen so far, largest first.
+     */
+    std::vector<Entry> topDeviceTypes(std::size_t n, Order by=BY_BYTES) const {
+        return rank(std::vector<Entry>(deviceTypes.begin(), deviceTypes.end()), n, by);
+    }
+
+    /**
+     * Clears every count, e.g. after a warmup.
+     */
+    void reset() {
+        std::fill(packetTypes, packetTypes + 256, TrafficCounts{});
+        deviceTypes.clear();
+    }
+
+    /**
+     * Estimates the heap memory the device type counts hold.
+     * \returns Bytes.
+     */
+    std::size_t memoryUsage() const {
+        std::size_t bytes = deviceTypes.size() * memory::mapNode<std::string, TrafficCounts>();
+        for (const auto& t : deviceTypes) {
+            bytes += memory::heap(t.first);
+        }
+        return bytes;
+    }
+
+    /**
+     * Writes the top packet types and device types by bytes as tables.
+     * \param out Stream to write to.
+     * \param n Maximum number of entries per table, 0 for all.
+     */
+    void report(std::ostream& out, std::size_t n) const {
+        table(out, "packet type", topPacketTypes(n));
+        table(out, "device type", topDeviceTypes(n));
+    }
+
+private:
+    static std::vector<Entry> rank(std::vector<Entry> entries, std::size_t n, Order by) {
+        const auto key = [by](const TrafficCounts& c) {
+            return by == BY_MESSAGES ? c.messages() : by == BY_TIME ? c.time() : c.bytes();
+        };
+        const auto larger = [&key](const Entry& a, const Entry& b) {
+            return key(a.second) > key(b.second);
+        };
+
+        if (n > 0 && n < entries.size()) {
+            std::partial_sort(entries.begin(), entries.begin() + n, entries.end(), larger);
+            entries.resize(n);
+        }
+        else {
+            std::sort(entries.begin(), entries.end(), larger);
+        }
+        return entries;
+    }
+
+    static void table(std::ostream& out, const char* title, const std::vector<Entry>& entries) {
+        char line[160];
+        std::snprintf(line, sizeof(line), "%-20s %10s %12s %11s %10s %12s %11s\n",
+                      title, "sent", "bytes", "encode ms", "received", "bytes", "decode ms");
+        out << line;
+
+        for (const Entry& e : entries) {
+            const TrafficCounts& c = e.second;
+            std::snprintf(line, sizeof(line), "%-20.20s %10llu %12llu %11.3f %10llu %12llu %11.3f\n",
+                          e.first.c_str(), (unsigned long long) c.sent, (unsigned long long) c.sentBytes,
+                          c.encodeTime / 1e6, (unsigned long long) c.received,
+                          (unsigned long long) c.receivedBytes, c.decodeTime / 1e6);
+            out << line;
+        }
+    }
+};
+
+}
+
+#endif // PAIRSIM_ACCOUNTING_HPP_
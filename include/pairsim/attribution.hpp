@@ -0,0 +1,115 @@
+
+#ifndef PAIRSIM_ATTRIBUTION_HPP_
+#define PAIRSIM_ATTRIBUTION_HPP_
+
+// Standard lib utilities
+#include <cstdint>
+
+#include "timing.hpp"
+
+namespace ps {
+
+/**
+ * Where the time of one lockstep tick went. In lockstep each side waits
+ * for the other's step, serialization and send plus a round trip, so
+ * with both sides' phase times the round trip can be told apart from
+ * either side's work.
+ */
+struct TickAttribution {
+    /** What took the longest. */
+    enum Bottleneck {
+        CLIENT = 0,
+        SERVER = 1,
+        NETWORK = 2,
+    };
+
+    /** Tick index, from the side that computed it. */
+    std::uint64_t tick;
+
+    /** Client's step, serialization and send time, in ns. */
+    std::uint64_t client;
+
+    /** Server's step, serialization and send time, in ns. */
+    std::uint64_t server;
+
+    /** Round trip time not spent in either side's work, in ns. Includes
+     * handling of received packets. */
+    std::uint64_t network;
+
+    Bottleneck bottleneck;
+
+    /**
+     * Attributes a tick from the phase times of both sides, each summed
+     * over one whole cycle (see Node::setWaitAttribution).
+     * \param tick Tick index.
+     * \param clientPhases Client's time per phase, in ns.
+     * \param serverPhases Server's time per phase, in ns.
+     * \returns Attribution.
+     */
+    static TickAttribution from(std::uint64_t tick, const std::uint64_t (&clientPhases)[PHASE_COUNT],
+                                const std::uint64_t (&serverPhases)[PHASE_COUNT]) {
+        TickAttribution a;
+        a.tick = tick;
+        a.client = clientPhases[STEP_PHASE] + clientPhases[SERIALIZE_PHASE] + clientPhases[SEND_PHASE];
+        a.server = serverPhases[STEP_PHASE] + serverPhases[SERIALIZE_PHASE] + serverPhases[SEND_PHASE];
+
+        // each side's wait is the other's work plus a round trip
+        const std::int64_t roundTrip = ((std::int64_t) clientPhases[WAIT_PHASE] - (std::int64_t) a.server
+                                      + (std::int64_t) serverPhases[WAIT_PHASE] - (std::int64_t) a.client) / 2;
+        a.network = roundTrip > 0 ? roundTrip : 0;
+
+        a.bottleneck = CLIENT;
+        if (a.server > a.client) {
+            a.bottleneck = SERVER;
+        }
+        if (a.network > (a.bottleneck == CLIENT ? a.client : a.server)) {
+            a.bottleneck = NETWORK;
+        }
+        return a;
+    }
+};
+
+/**
+ * Attributions aggregated over many ticks.
+ */
+struct AttributionSummary {
+    /** Number of attributed ticks. */
+    std::uint64_t ticks;
+
+    /** Sums of TickAttribution's times, in ns. */
+    std::uint64_t client;
+    std::uint64_t server;
+    std::uint64_t network;
+
+    /** Ticks each bottleneck was hit, by TickAttribution::Bottleneck. */
+    std::uint64_t bottlenecks[3];
+
+    /**
+     * Adds a tick.
+     * \param a Tick attribution.
+     */
+    void add(const TickAttribution& a) {
+        ticks++;
+        client += a.client;
+        server += a.server;
+        network += a.network;
+        bottlenecks[a.bottleneck]++;
+    }
+
+    /**
+     * Gets the share of the time in lockstep taken by each part.
+     * \param part Part, see TickAttribution::Bottleneck.
+     * \returns Share, from 0 to 1.
+     */
+    double share(TickAttribution::Bottleneck part) const {
+        const double total = (double) client + server + network;
+        if (total == 0) {
+            return 0;
+        }
+        return (part == TickAttribution::CLIENT ? client : part == TickAttribution::SERVER ? server : network) / total;
+    }
+};
+
+}
+
+#endif // PAIRSIM_ATTRIBUTION_HPP_
@@ -3,6 +3,8 @@
 #define PAIRSIM_BUFFER_HPP_
 
 // Standard lib utilities
+#include <cstddef>
+#include <cstdint>
 #include <vector>
 
 namespace ps {
@@ -10,6 +12,18 @@ namespace ps {
  * Buffer definition.
  */
 using Buffer = std::vector<std::uint8_t>;
+
+/**
+ * Non-owning view over received bytes. Its lifetime is defined by
+ * whoever produced it, usually until the next Transport::recv().
+ */
+struct BufferView {
+    /** Pointer to the first byte. */
+    const std::uint8_t* data;
+
+    /** Number of bytes. */
+    std::size_t size;
+};
 }
 
 #endif // PAIRSIM_BUFFER_HPP_
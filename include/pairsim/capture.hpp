@@ -0,0 +1,331 @@
+
+#ifndef PAIRSIM_CAPTURE_HPP_
+#define PAIRSIM_CAPTURE_HPP_
+
+// Standard lib utilities
+#include <chrono>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+// POSIX files and memory mapping
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Internal classes
+#include "clock.hpp"
+
+namespace ps {
+
+/**
+ * On-disk layout of capture logs. A log is a FileHeader followed by
+ * records, each a RecordHeader and the packet bytes exactly as they went
+ * over the wire, padded to 8 bytes.
+ */
+namespace capture {
+
+/** Magic number, "PSC1". */
+static constexpr std::uint32_t MAGIC = 0x31435350;
+
+/** Which side of the pair wrote the log. */
+enum Role : std::uint8_t {
+    CLIENT = 'c',
+    SERVER = 's',
+};
+
+/** Packet direction, seen from the recording node. */
+enum Direction : std::uint8_t {
+    SENT = '>',
+    RECEIVED = '<',
+};
+
+/** Start of every capture log. */
+struct FileHeader {
+    std::uint32_t magic;
+    std::uint8_t role;
+    std::uint8_t reserved[3];
+
+    /** Wall clock time the capture started, in ns since the epoch. */
+    std::uint64_t startTime;
+};
+
+/** Start of every record. */
+struct RecordHeader {
+    /** Packet size, not including this header or padding. */
+    std::uint32_t size;
+
+    /** Direction, see Direction. */
+    std::uint8_t direction;
+
+    /** Packet type, see PacketType. */
+    std::uint8_t type;
+
+    std::uint16_t reserved;
+
+    /** Tick the packet belongs to: the sender's tick index. */
+    std::uint64_t tick;
+
+    /** Time since the capture started, in ns. */
+    std::uint64_t time;
+};
+
+/**
+ * Size taken by a record, kept 8-byte aligned.
+ * \param size Packet size.
+ */
+inline std::size_t recordSize(std::size_t size) {
+    return (sizeof(RecordHeader) + size + 7) & ~std::size_t(7);
+}
+
+}
+
+/**
+ * Append-only capture log. The file is memory mapped and grown in large
+ * chunks, so recording a packet is a memcpy into the mapping; the kernel
+ * writes pages back on its own and the file is trimmed on close.
+ */
+class CaptureLog {
+private:
+    /** How much the file grows at a time. */
+    static constexpr std::size_t CHUNK = 16 << 20;
+
+    /** File descriptor. */
+    int fd;
+
+    /** Mapped file. */
+    std::uint8_t* data;
+
+    /** Mapped (and allocated) file size. */
+    std::size_t capacity;
+
+    /** Bytes written so far. */
+    std::size_t used;
+
+    /** Time source of the record timestamps. */
+    Clock& clock;
+
+    /** When the capture started. */
+    Clock::time_point start;
+
+public:
+    /**
+     * Creates a capture log, truncating the file if it exists.
+     * \param path File path.
+     * \param role Which side of the pair is recording.
+     * \param _clock Time source of the record timestamps, so that
+     * captures of virtual time runs replay at their simulated pace.
+     */
+    CaptureLog(const std::string& path, capture::Role role, Clock& _clock=SteadyClock::instance())
+        : fd{-1}, data{nullptr}, capacity{0}, used{0}, clock{_clock}, start{_clock.now()} {
+        fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) {
+            throw std::runtime_error("can't open capture " + path + ": " + std::strerror(errno));
+        }
+
+        reserve(sizeof(capture::FileHeader));
+
+        capture::FileHeader header{};
+        header.magic = capture::MAGIC;
+        header.role = role;
+        header.startTime = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+
+        std::memcpy(data, &header, sizeof(header));
+        used = sizeof(header);
+    }
+
+    CaptureLog(const CaptureLog& rhs) = delete;
+    CaptureLog& operator=(const CaptureLog& rhs) = delete;
+
+    /**
+     * Closes the log, trimming the file to what was written.
+     */
+    ~CaptureLog() {
+        if (data != nullptr) {
+            munmap(data, capacity);
+        }
+        if (fd >= 0) {
+            if (ftruncate(fd, used) != 0) {
+                // nothing sensible to do in a destructor
+            }
+            close(fd);
+        }
+    }
+
+    /**
+     * Appends a packet.
+     * \param direction Whether it was sent or received.
+     * \param type Packet type.
+     * \param tick Tick the packet belongs to.
+     * \param bytes Packet bytes.
+     * \param size Packet size.
+     */
+    void append(capture::Direction direction, std::uint8_t type, std::uint64_t tick,
+                const std::uint8_t* bytes, std::size_t size) {
+        const std::size_t record = capture::recordSize(size);
+        reserve(used + record);
+
+        capture::RecordHeader header{};
+        header.size = size;
+        header.direction = direction;
+        header.type = type;
+        header.tick = tick;
+        header.time = std::chrono::duration_cast<std::chrono::nanoseconds>(clock.now() - start).count();
+
+        std::memcpy(data + used, &header, sizeof(header));
+        std::memcpy(data + used + sizeof(header), bytes, size);
+        used += record;
+    }
+
+private:
+    /**
+     * Grows the file and its mapping to hold at least some bytes.
+     * \param size Bytes needed.
+     */
+    void reserve(std::size_t size) {
+        if (size <= capacity) {
+            return;
+        }
+
+        std::size_t grown = capacity;
+        while (grown < size) {
+            grown += CHUNK;
+        }
+
+        if (ftruncate(fd, grown) != 0) {
+            throw std::runtime_error(std::string("can't grow capture: ") + std::strerror(errno));
+        }
+        if (data != nullptr) {
+            munmap(data, capacity);
+            data = nullptr;
+        }
+
+        void* addr = mmap(nullptr, grown, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (addr == MAP_FAILED) {
+            throw std::runtime_error(std::string("can't map capture: ") + std::strerror(errno));
+        }
+
+        data = static_cast<std::uint8_t*>(addr);
+        capacity = grown;
+    }
+};
+
+/**
+ * Read-only view over a capture log.
+ */
+class CaptureReader {
+public:
+    /** A record and its packet bytes, pointing into the mapping. */
+    struct Record {
+        capture::RecordHeader header;
+        const std::uint8_t* bytes;
+    };
+
+private:
+    /** Mapped file. */
+    const std::uint8_t* data;
+
+    /** File size. */
+    std::size_t size;
+
+    /** Offset of the next record. */
+    std::size_t offset;
+
+    /** File header. */
+    capture::FileHeader header;
+
+public:
+    /**
+     * Opens a capture log.
+     * \param path File path.
+     */
+    CaptureReader(const std::string& path) : data{nullptr}, size{0}, offset{0}, header{} {
+        const int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            throw std::runtime_error("can't open capture " + path + ": " + std::strerror(errno));
+        }
+
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size < (off_t) sizeof(capture::FileHeader)) {
+            close(fd);
+            throw std::runtime_error("invalid capture " + path);
+        }
+        size = st.st_size;
+
+        void* addr = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (addr == MAP_FAILED) {
+            throw std::runtime_error("can't map capture " + path + ": " + std::strerror(errno));
+        }
+        data = static_cast<const std::uint8_t*>(addr);
+
+        std::memcpy(&header, data, sizeof(header));
+        if (header.magic != capture::MAGIC) {
+            munmap(const_cast<std::uint8_t*>(data), size);
+            throw std::runtime_error("invalid capture " + path);
+        }
+        offset = sizeof(header);
+    }
+
+    CaptureReader(const CaptureReader& rhs) = delete;
+    CaptureReader& operator=(const CaptureReader& rhs) = delete;
+
+    /**
+     * Unmaps the log.
+     */
+    ~CaptureReader() {
+        munmap(const_cast<std::uint8_t*>(data), size);
+    }
+
+    /**
+     * Which side of the pair wrote the log.
+     * \returns capture::CLIENT or capture::SERVER.
+     */
+    capture::Role getRole() {
+        return capture::Role(header.role);
+    }
+
+    /**
+     * Wall clock time the capture started.
+     * \returns Nanoseconds since the epoch.
+     */
+    std::uint64_t getStartTime() {
+        return header.startTime;
+    }
+
+    /**
+     * Reads the next record. A truncated trailing record, e.g. from a
+     * crashed recorder, ends the log.
+     * \param record Output record.
+     * \returns `false` at the end of the log.
+     */
+    bool next(Record& record) {
+        if (offset + sizeof(capture::RecordHeader) > size) {
+            return false;
+        }
+
+        std::memcpy(&record.header, data + offset, sizeof(record.header));
+        if (record.header.direction == 0 || offset + capture::recordSize(record.header.size) > size) {
+            return false;
+        }
+
+        record.bytes = data + offset + sizeof(capture::RecordHeader);
+        offset += capture::recordSize(record.header.size);
+        return true;
+    }
+
+    /**
+     * Goes back to the first record.
+     */
+    void rewind() {
+        offset = sizeof(capture::FileHeader);
+    }
+};
+
+}
+
+#endif // PAIRSIM_CAPTURE_HPP_
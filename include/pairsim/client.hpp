@@ -8,14 +8,6 @@
 #include "node.hpp"
 #include "client_model.hpp"
 
-// Debugging log
-#ifdef PAIRSIM_DEBUG_ENABLED
-#include <iostream>
-#define PAIRSIM_DEBUG(str) std::cout << "[PS] " << str << std::endl
-#else
-#define PAIRSIM_DEBUG(str)
-#endif
-
 namespace ps {
 
 template <typename DurationType=std::chrono::milliseconds, typename DevicePtrType=std::shared_ptr<Device>>
@@ -71,6 +63,14 @@ public:
         this->retryDelay = _retryDelay;
     }
 
+    /**
+     * Gets the retry delay.
+     * \returns Delay between ready checks with the server.
+     */
+    std::chrono::milliseconds getRetryDelay() {
+        return this->retryDelay;
+    }
+
     /**
      * Adds a device to the monitoring list.
      * After this, any data directed to it will be directly sent to
@@ -78,12 +78,13 @@ public:
      * \param d Device to be added.
      */
     void addDevice(DevicePtrType d) {
-        PAIRSIM_DEBUG("Adding device " << d->getId());
+        PAIRSIM_LOG_DEBUG("Adding device {}", d->getId());
         if (d == nullptr) {
             throw std::runtime_error("Caca 3");
         }
+        PAIRSIM_PROBE3(device__add, (char) this->role, d->getDeviceType().c_str(), d->getId());
 
-        this->queue.push(packet::deviceAdd<DevicePtrType>(d));
+        this->enqueue(PacketType::DEVICE_ADD, packet::deviceAdd<DevicePtrType>(d));
 
         this->devices.push_back(d);
         this->devicesByType[d->getDeviceType()][d->getId()] = d;
@@ -95,27 +96,32 @@ public:
      */
     void setup() {
         state = State::SETTING_UP;
+        PAIRSIM_TIME_PHASE(SETUP_PHASE);
+        PAIRSIM_PHASE_HOOKS(SETUP_PHASE);
 
         this->checkParams();
 
-        PAIRSIM_DEBUG("Dialing");
-        this->sock.dial(this->address.c_str());
-        PAIRSIM_DEBUG("Done!");
+        PAIRSIM_LOG_DEBUG("Dialing");
+        this->transport = this->makeTransport();
+        this->transport->dial(this->address);
+        PAIRSIM_LOG_DEBUG("Done!");
         this->running = true;
+        this->queueSettings();
+        this->startCapture(capture::CLIENT);
 
         // sends a READY to the server and waits for a READY
-        PAIRSIM_DEBUG("Are you ready?");
-        this->queue.push(packet::ready());
+        PAIRSIM_LOG_DEBUG("Are you ready?");
+        this->enqueue(PacketType::READY, packet::ready());
         this->flush();
         this->waitFor(PacketType::READY);
-        PAIRSIM_DEBUG("OK, its ready?");
+        PAIRSIM_LOG_DEBUG("OK, its ready?");
 
         // sends setup data
-        PAIRSIM_DEBUG("Setting up then.");
+        PAIRSIM_LOG_DEBUG("Setting up then.");
         this->model->setup(this);
-        this->queue.push(packet::setup());
+        this->enqueue(PacketType::SETUP, packet::setup());
         this->flush();
-        PAIRSIM_DEBUG("Sent info. Now waiting for new data!");
+        PAIRSIM_LOG_DEBUG("Sent info. Now waiting for new data!");
 
         // processes received data until a SETUP is received
         this->waitFor(PacketType::SETUP);
@@ -123,6 +129,61 @@ public:
         state = State::SHOULD_GET_DATA;
     }
 
+#ifdef __cpp_impl_coroutine
+    /**
+     * Awaitable version of setup(). Dialing is still synchronous; the
+     * waits for the server's READY and SETUP suspend on the event loop.
+     */
+    Task setupAsync() {
+        state = State::SETTING_UP;
+        PAIRSIM_TIME_PHASE(SETUP_PHASE);
+        PAIRSIM_PHASE_HOOKS(SETUP_PHASE);
+
+        this->checkParams();
+        this->checkLoop();
+
+        PAIRSIM_LOG_DEBUG("Dialing");
+        this->transport = this->makeTransport();
+        this->transport->dial(this->address);
+        this->running = true;
+        this->queueSettings();
+        this->startCapture(capture::CLIENT);
+
+        this->enqueue(PacketType::READY, packet::ready());
+        this->flush();
+        co_await this->waitForAsync(PacketType::READY);
+
+        this->model->setup(this);
+        this->enqueue(PacketType::SETUP, packet::setup());
+        this->flush();
+
+        co_await this->waitForAsync(PacketType::SETUP);
+
+        state = State::SHOULD_GET_DATA;
+    }
+
+    /**
+     * Awaitable version of tick().
+     */
+    Task tickAsync() {
+        getData();
+        sendData();
+        co_await waitTickAsync();
+    }
+
+    /**
+     * Awaitable version of waitTick().
+     */
+    Task waitTickAsync() {
+        state = State::WAITING_TICK;
+        PAIRSIM_TIME_PHASE(WAIT_PHASE);
+        PAIRSIM_PHASE_HOOKS(WAIT_PHASE);
+        PAIRSIM_LOG_DEBUG("Waiting for tick.");
+        co_await this->waitForAsync(PacketType::TICK);
+        state = State::SHOULD_GET_DATA;
+    }
+#endif
+
     /**
      * Runs ClientModel::step and sends device data.
      * Blocks until the server's tick finishes.
@@ -138,7 +199,9 @@ public:
      */
     void waitTick() {
         state = State::WAITING_TICK;
-        PAIRSIM_DEBUG("Waiting for tick.");
+        PAIRSIM_TIME_PHASE(WAIT_PHASE);
+        PAIRSIM_PHASE_HOOKS(WAIT_PHASE);
+        PAIRSIM_LOG_DEBUG("Waiting for tick.");
         this->waitFor(PacketType::TICK);
         state = State::SHOULD_GET_DATA;
     }
@@ -148,14 +211,24 @@ public:
      */
     void getData() {
         state = State::GETTING_DATA;
-        PAIRSIM_DEBUG("Sending data.");
-        this->model->step(this);
+        PAIRSIM_LOG_DEBUG("Sending data.");
+        PAIRSIM_PROBE2(tick__begin, (char) this->role, this->tickCount);
+        this->closeCycle();
+        {
+            PAIRSIM_TIME_PHASE(STEP_PHASE);
+            PAIRSIM_PHASE_HOOKS(STEP_PHASE);
+            PAIRSIM_PROBE2(model__step__begin, (char) this->role, this->tickCount);
+            this->model->step(this);
+            PAIRSIM_PROBE2(model__step__end, (char) this->role, this->tickCount);
+        }
 
-        for (size_t i = 0; i < this->devices.size(); i++) {
-            this->queue.push(packet::device<DevicePtrType>(this->devices[i]));
+        {
+            PAIRSIM_TIME_PHASE(SERIALIZE_PHASE);
+            PAIRSIM_PHASE_HOOKS(SERIALIZE_PHASE);
+            this->queueDeviceUpdates();
         }
 
-        this->queue.push(packet::tick());
+        this->queueTick();
         state = State::SHOULD_SEND_DATA;
     }
 
@@ -164,7 +237,10 @@ public:
      */
     void sendData() {
         state = State::SENDING_DATA;
+        PAIRSIM_TIME_PHASE(SEND_PHASE);
+        PAIRSIM_PHASE_HOOKS(SEND_PHASE);
         this->flush();
+        PAIRSIM_PROBE2(tick__end, (char) this->role, this->tickCount - 1);
         state = State::SHOULD_WAIT_TICK;
     }
 
@@ -190,8 +266,8 @@ private:
      * \param JSON message received.
      */
     void handleNotReady(json msg) {
-        std::this_thread::sleep_for(retryDelay);
-        this->queue.push(packet::ready());
+        this->clock->sleepFor(getRetryDelay());
+        this->enqueue(PacketType::READY, packet::ready());
         this->flush();
     }
 };
@@ -39,6 +39,17 @@ public:
      */
     virtual void end() = 0;
 
+    /**
+     * Called when the real-time factor both sides agreed on changes (see
+     * Node::setRealTimeFactor), e.g. to scale the time of a simulator
+     * that runs on its own.
+     * \param factor Simulated seconds per wall second, 0 for as fast as
+     * possible.
+     */
+    virtual void onRealTimeFactor(double factor) {
+        // no-op
+    }
+
     /**
      * Indicates whether the model is ready to start the communication.
      * \returns `true` if the model is ready or `false` otherwise.
@@ -0,0 +1,128 @@
+
+#ifndef PAIRSIM_CLOCK_HPP_
+#define PAIRSIM_CLOCK_HPP_
+
+// Standard lib utilities
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <thread>
+
+namespace ps {
+
+/**
+ * Source of time for pairsim's own timing: retry delays, replay pacing,
+ * event loop timers, tick overruns and the transport statistics interval.
+ * Nodes use SteadyClock unless given another one, see Node::setClock.
+ * Profiling (phase timers, traces, log timestamps) always measures wall
+ * time, as it is about the cost of the work itself.
+ */
+class Clock {
+public:
+    /** Time points share std::chrono::steady_clock's type, so that they
+     * can be stored and compared alike whatever the clock. */
+    using time_point = std::chrono::steady_clock::time_point;
+
+    virtual ~Clock() {}
+
+    /**
+     * Gets the current time.
+     * \returns Time point.
+     */
+    virtual time_point now() = 0;
+
+    /**
+     * Blocks the calling thread until a time point is reached.
+     * \param t Time point.
+     */
+    virtual void sleepUntil(time_point t) = 0;
+
+    /**
+     * Whether time moves on its own. When it doesn't, waiting for a
+     * deadline means jumping to it, e.g. for event loop timers.
+     * \returns `true` for clocks that don't follow wall time.
+     */
+    virtual bool isVirtual() {
+        return false;
+    }
+
+    /**
+     * Blocks the calling thread for a while.
+     * \param duration Time to sleep.
+     */
+    template <typename Rep, typename Period>
+    void sleepFor(std::chrono::duration<Rep, Period> duration) {
+        sleepUntil(now() + std::chrono::duration_cast<time_point::duration>(duration));
+    }
+};
+
+/**
+ * Wall time, from std::chrono::steady_clock.
+ */
+class SteadyClock : public Clock {
+public:
+    /**
+     * Gets the process-wide instance, the default of every node.
+     * \returns Clock.
+     */
+    static SteadyClock& instance() {
+        static SteadyClock clock;
+        return clock;
+    }
+
+    time_point now() {
+        return std::chrono::steady_clock::now();
+    }
+
+    void sleepUntil(time_point t) {
+        std::this_thread::sleep_until(t);
+    }
+};
+
+/**
+ * Simulated time, starting at 0, that only moves when slept on or
+ * advanced. Sleeping returns right away with the clock moved to the
+ * deadline, so that retry delays and tick pacing take no wall time and
+ * test scenarios run as fast as the CPU allows, ticking exactly as they
+ * would in real time.
+ *
+ * Safe to share between threads, e.g. by both nodes of an in-process
+ * pair: the clock only ever moves forward, to the latest deadline any
+ * of them slept until.
+ */
+class VirtualClock : public Clock {
+private:
+    /** Time since the clock's start, in ns. */
+    std::atomic<std::int64_t> elapsed;
+
+public:
+    VirtualClock() : elapsed{0} {}
+
+    time_point now() {
+        return time_point{std::chrono::nanoseconds(elapsed.load(std::memory_order_acquire))};
+    }
+
+    void sleepUntil(time_point t) {
+        const std::int64_t target = std::chrono::duration_cast<std::chrono::nanoseconds>(t.time_since_epoch()).count();
+        std::int64_t current = elapsed.load(std::memory_order_relaxed);
+        while (current < target && !elapsed.compare_exchange_weak(current, target, std::memory_order_acq_rel)) {}
+    }
+
+    bool isVirtual() {
+        return true;
+    }
+
+    /**
+     * Moves the clock forward, e.g. from a driver stepping several nodes.
+     * \param duration Time to add.
+     */
+    template <typename Rep, typename Period>
+    void advance(std::chrono::duration<Rep, Period> duration) {
+        elapsed.fetch_add(std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count(),
+                          std::memory_order_acq_rel);
+    }
+};
+
+}
+
+#endif // PAIRSIM_CLOCK_HPP_
@@ -0,0 +1,117 @@
+
+#ifndef PAIRSIM_COUNTERS_HPP_
+#define PAIRSIM_COUNTERS_HPP_
+
+// Standard lib utilities
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+// Internal classes
+#include "transport.hpp"
+
+namespace ps {
+
+/**
+ * Counter written by the node's thread and read from any other, e.g. by
+ * the metrics endpoint. As there is a single writer, updates are a plain
+ * load and store rather than an atomic read-modify-write, so they cost
+ * the same as on a bare integer.
+ */
+class Counter {
+private:
+    std::atomic<std::uint64_t> value;
+
+public:
+    Counter() : value{0} {}
+
+    Counter(const Counter& rhs) = delete;
+    Counter& operator=(const Counter& rhs) = delete;
+
+    /**
+     * Adds to the counter. Only the owning thread may call it.
+     * \param n Amount.
+     */
+    void add(std::uint64_t n=1) {
+        value.store(value.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+
+    /**
+     * Sets the counter, for gauges. Only the owning thread may call it.
+     * \param n Value.
+     */
+    void set(std::uint64_t n) {
+        value.store(n, std::memory_order_relaxed);
+    }
+
+    /**
+     * Reads the counter, from any thread.
+     * \returns Value.
+     */
+    std::uint64_t get() const {
+        return value.load(std::memory_order_relaxed);
+    }
+};
+
+/**
+ * Packets and bytes of one packet type in one direction.
+ */
+struct PacketCounters {
+    Counter packets;
+
+    /** Encoded bytes. Devices handed over in memory add none. */
+    Counter bytes;
+};
+
+/**
+ * Counters a node keeps while running, readable from any thread.
+ */
+struct NodeCounters {
+    /** TICKs sent. */
+    Counter ticks;
+
+    /** TICKs received from the peer. */
+    Counter peerTicks;
+
+    /** By PacketType. */
+    PacketCounters sent[256];
+    PacketCounters received[256];
+
+    /** Ticks that took longer than the node's tick duration, when set. */
+    Counter overruns;
+
+    /** Packets sent by the last flush. */
+    Counter queueDepth;
+
+    /** Devices this node sends. */
+    Counter devices;
+};
+
+/**
+ * Snapshot of a node's counters and its transport's statistics, see
+ * Node::stats.
+ */
+struct NodeStats {
+    std::uint64_t ticks;
+    std::uint64_t peerTicks;
+    std::uint64_t overruns;
+    std::uint64_t queueDepth;
+    std::uint64_t devices;
+
+    /** Totals over every packet type. */
+    std::uint64_t packetsSent;
+    std::uint64_t bytesSent;
+    std::uint64_t packetsReceived;
+    std::uint64_t bytesReceived;
+
+    /** Whether the transport keeps statistics, i.e. transport is valid. */
+    bool hasTransport;
+
+    /** Transport statistics, as of transportTime. */
+    TransportStats transport;
+    std::chrono::steady_clock::time_point transportTime;
+};
+
+}
+
+#endif // PAIRSIM_COUNTERS_HPP_
@@ -2,13 +2,49 @@
 #ifndef PAIRSIM_DEVICE_HPP_
 #define PAIRSIM_DEVICE_HPP_
 
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
 #include <json.hpp>
 using json = nlohmann::json;
 
+#include "footprint.hpp"
+#include "position.hpp"
+#include "subscription.hpp"
+
 static std::uint32_t deviceCount = 0;
 
 namespace ps {
 
+/**
+ * Dead reckoning state: a position and velocity taken on some tick,
+ * from which later positions are predicted.
+ */
+struct Reckoning {
+    /** Whether the state was ever set. */
+    bool valid;
+
+    /** Position on the tick. */
+    Position pos;
+
+    /** Velocity, in position units per tick. */
+    Position vel;
+
+    /** Sender tick the state was taken on. */
+    std::uint64_t tick;
+
+    /**
+     * Predicts the position on a later tick, assuming constant velocity.
+     * \param at Sender tick.
+     * \returns Predicted position.
+     */
+    Position predict(std::uint64_t at) const {
+        const double dt = (double) at - (double) tick;
+        return Position{pos.x + vel.x * dt, pos.y + vel.y * dt, pos.z + vel.z * dt};
+    }
+};
+
 class Device {
 
 private:
@@ -18,6 +54,24 @@ private:
     /** Device Type. This should be set in each child class. */
     std::string deviceType;
 
+    /** Send the device every updatePeriod ticks. */
+    std::uint32_t updatePeriod;
+
+    /** Only send when some field moved more than this. Disabled if <= 0. */
+    double changeThreshold;
+
+    /** Whether the device was ever sent. */
+    bool sent;
+
+    /** Last state sent, kept when changeThreshold is set. */
+    json lastSent;
+
+    /** Dead reckoning state last sent to the peer. */
+    Reckoning sentReckoning;
+
+    /** Dead reckoning state last received from the peer. */
+    Reckoning receivedReckoning;
+
 public:
     /**
      * Builds a JSON object with the info to be sent.
@@ -29,11 +83,75 @@ public:
      */
     virtual void deserialize(json j) = 0;
 
+    /**
+     * Builds a JSON object with only some of the info, as subscribed by
+     * the peer. Defaults to filtering serialize()'s result; override to
+     * skip gathering fields nobody asked for.
+     * \param fields Field paths, see Subscription.
+     */
+    virtual json serializeFields(const std::vector<std::string>& fields) {
+        return Subscription::select(serialize(), fields);
+    }
+
+    /**
+     * Reports where the device is, for spatial interest filtering
+     * (see Subscription::addObserver). Called once per tick while the
+     * peer has spatial interest.
+     * \param pos Output position.
+     * \returns `false` if the device has no position, in which case
+     * it's never culled.
+     */
+    virtual bool getPosition(Position& pos) {
+        return false;
+    }
+
+    /**
+     * Reports the device's velocity, for dead reckoning (see
+     * Node::setDeadReckoning). Only used together with getPosition().
+     * \param vel Output velocity, in position units per tick.
+     * \returns `false` if the device has no velocity.
+     */
+    virtual bool getVelocity(Position& vel) {
+        return false;
+    }
+
+    /**
+     * Called on the receiving side on every peer tick that brought no
+     * update for a dead reckoned device, with the predicted state.
+     * Override to move the device along; does nothing by default.
+     * \param pos Predicted position.
+     * \param vel Last velocity received.
+     */
+    virtual void extrapolate(const Position& pos, const Position& vel) {}
+
+    /**
+     * Copies the state of the peer's instance of this device. Used by
+     * in-process pairs instead of serialize()/deserialize().
+     * \param other Peer device, with the same type and ID.
+     * \returns `false` if unsupported, falling back to serialization.
+     */
+    virtual bool copyFrom(Device& other) {
+        return false;
+    }
+
+    /**
+     * Reports the memory the device holds, see Node::memoryFootprint.
+     * Only covers the Device part; subclasses with more state should add
+     * theirs, e.g. `sizeof(MyDevice) - sizeof(Device)` plus what their
+     * members hold on the heap.
+     * \returns Bytes.
+     */
+    virtual std::size_t memoryUsage() {
+        return sizeof(Device) + memory::heap(deviceType) + memory::heap(lastSent);
+    }
+
     /**
      * Creates a Device instance.
      * \param _deviceType Device type, defined by a std::string.
      */
-    Device(std::string _deviceType) : id{++deviceCount}, deviceType{_deviceType} {}
+    Device(std::string _deviceType) : id{++deviceCount}, deviceType{_deviceType}, updatePeriod{1},
+                                      changeThreshold{0}, sent{false}, lastSent{nullptr},
+                                      sentReckoning{}, receivedReckoning{} {}
 
     /**
      * Gets the device's ID.
@@ -52,6 +170,132 @@ public:
      * \returns Device type.
      */
     std::string getDeviceType() { return deviceType; }
+
+    /**
+     * Sets how often the device is sent. The peer keeps the last state
+     * it received in between.
+     * \param _updatePeriod Period in ticks, 1 meaning every tick.
+     */
+    void setUpdatePeriod(std::uint32_t _updatePeriod) { updatePeriod = _updatePeriod > 0 ? _updatePeriod : 1; }
+
+    /**
+     * Gets the update period.
+     * \returns Period in ticks.
+     */
+    std::uint32_t getUpdatePeriod() { return updatePeriod; }
+
+    /**
+     * Only send the device when a numeric field of its serialized state
+     * changed by more than a threshold since it was last sent (any other
+     * change always counts). This costs a serialize() on every due tick.
+     * \param _changeThreshold Threshold, <= 0 to disable.
+     */
+    void setChangeThreshold(double _changeThreshold) { changeThreshold = _changeThreshold; }
+
+    /**
+     * Gets the change threshold.
+     * \returns Threshold, <= 0 when disabled.
+     */
+    double getChangeThreshold() { return changeThreshold; }
+
+    /**
+     * Decides whether the device is due on a tick. By default that's every
+     * updatePeriod ticks, staggered by ID so that slow devices don't all
+     * land on the same tick. Override for custom policies; the device is
+     * always sent on its first tick regardless.
+     * \param tick Index of the tick being sent.
+     * \returns `true` if the device should be sent.
+     */
+    virtual bool isDue(std::uint64_t tick) {
+        return updatePeriod <= 1 || (tick + id) % updatePeriod == 0;
+    }
+
+    /**
+     * Whether the device was ever sent.
+     * \returns `true` after the first send.
+     */
+    bool wasSent() { return sent; }
+
+    /**
+     * Records that the device was sent.
+     */
+    void markSent() { sent = true; }
+
+    /**
+     * Checks serialized state against the change threshold, remembering
+     * it as the last sent state when it passes.
+     * \param data Freshly serialized state.
+     * \returns `true` if the device should be sent.
+     */
+    bool changedEnough(const json& data) {
+        if (sent && !lastSent.is_null() && maxDelta(data, lastSent) <= changeThreshold) {
+            return false;
+        }
+
+        lastSent = data;
+        return true;
+    }
+
+    /**
+     * Gets the dead reckoning state last sent.
+     * \returns State, invalid if none was sent.
+     */
+    const Reckoning& getSentReckoning() { return sentReckoning; }
+
+    /**
+     * Records the dead reckoning state sent along with the device.
+     * \param r Sent state.
+     */
+    void setSentReckoning(const Reckoning& r) { sentReckoning = r; }
+
+    /**
+     * Gets the dead reckoning state last received.
+     * \returns State, invalid if none was received.
+     */
+    const Reckoning& getReceivedReckoning() { return receivedReckoning; }
+
+    /**
+     * Records the dead reckoning state received along with the device.
+     * \param r Received state.
+     */
+    void setReceivedReckoning(const Reckoning& r) { receivedReckoning = r; }
+
+private:
+    /**
+     * Largest difference between numeric leaves of two JSON values.
+     * Structural or non-numeric differences count as infinite.
+     */
+    static double maxDelta(const json& a, const json& b) {
+        const double infinite = std::numeric_limits<double>::infinity();
+
+        if (a.is_number() && b.is_number()) {
+            return std::fabs(a.get<double>() - b.get<double>());
+        }
+        if (a.type() != b.type() || a.size() != b.size()) {
+            return infinite;
+        }
+
+        if (a.is_object()) {
+            double delta = 0;
+            for (auto it = a.begin(); it != a.end(); ++it) {
+                const auto other = b.find(it.key());
+                if (other == b.end()) {
+                    return infinite;
+                }
+                delta = std::max(delta, maxDelta(it.value(), *other));
+            }
+            return delta;
+        }
+        if (a.is_array()) {
+            double delta = 0;
+            for (std::size_t i = 0; i < a.size(); i++) {
+                delta = std::max(delta, maxDelta(a[i], b[i]));
+            }
+            return delta;
+        }
+
+        return a == b ? 0 : infinite;
+    }
 };
 
 }
@@ -0,0 +1,308 @@
+
+#ifndef PAIRSIM_EVENT_LOOP_HPP_
+#define PAIRSIM_EVENT_LOOP_HPP_
+
+// Standard lib utilities
+#include <chrono>
+#include <condition_variable>
+#include <coroutine>
+#include <deque>
+#include <exception>
+#include <map>
+#include <mutex>
+#include <vector>
+
+// Internal classes
+#include "clock.hpp"
+#include "transport.hpp"
+
+namespace ps {
+
+class EventLoop;
+
+/**
+ * Coroutine returned by the awaitable Client/Server API. It starts
+ * suspended and runs when awaited or when handed to EventLoop::spawn.
+ * Exceptions are rethrown to the awaiting coroutine.
+ */
+class Task {
+public:
+    struct promise_type {
+        /** Coroutine waiting for this one, if any. */
+        std::coroutine_handle<> continuation;
+
+        /** Loop that owns this task, if it was spawned. */
+        EventLoop* owner = nullptr;
+
+        /** Exception thrown by the body. */
+        std::exception_ptr error;
+
+        Task get_return_object() {
+            return Task{std::coroutine_handle<promise_type>::from_promise(*this)};
+        }
+
+        std::suspend_always initial_suspend() noexcept {
+            return {};
+        }
+
+        struct FinalAwaiter {
+            bool await_ready() noexcept {
+                return false;
+            }
+
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> h) noexcept;
+
+            void await_resume() noexcept {}
+        };
+
+        FinalAwaiter final_suspend() noexcept {
+            return {};
+        }
+
+        void return_void() {}
+
+        void unhandled_exception() {
+            error = std::current_exception();
+        }
+    };
+
+private:
+    /** Coroutine frame, destroyed with the task. */
+    std::coroutine_handle<promise_type> handle;
+
+    explicit Task(std::coroutine_handle<promise_type> h) : handle{h} {}
+
+    friend class EventLoop;
+
+public:
+    Task(Task&& rhs) noexcept : handle{rhs.handle} {
+        rhs.handle = nullptr;
+    }
+
+    Task(const Task& rhs) = delete;
+    Task& operator=(const Task& rhs) = delete;
+
+    ~Task() {
+        if (handle) {
+            handle.destroy();
+        }
+    }
+
+    bool await_ready() noexcept {
+        return false;
+    }
+
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept {
+        handle.promise().continuation = awaiting;
+        return handle;
+    }
+
+    void await_resume() {
+        if (handle.promise().error) {
+            std::rethrow_exception(handle.promise().error);
+        }
+    }
+};
+
+/**
+ * Single-threaded loop resuming coroutines once their receive or timer
+ * completes. Completions may come from any thread (e.g. NNG's aio
+ * callbacks); resumption always happens inside run().
+ */
+class EventLoop {
+private:
+    /** Guards ready and timers. */
+    std::mutex mtx;
+
+    /** Signals new work. */
+    std::condition_variable cv;
+
+    /** Coroutines ready to be resumed. */
+    std::deque<std::coroutine_handle<>> ready;
+
+    /** Sleeping coroutines by deadline. */
+    std::multimap<Clock::time_point, std::coroutine_handle<>> timers;
+
+    /** Top-level tasks. */
+    std::vector<Task> tasks;
+
+    /** Spawned tasks that didn't finish yet. */
+    std::size_t remaining;
+
+    /** First error thrown by a spawned task. */
+    std::exception_ptr error;
+
+    /** Time source of the timers. */
+    Clock* clock;
+
+public:
+    /**
+     * Creates an event loop, only initializes members.
+     */
+    EventLoop() : remaining{0}, error{nullptr}, clock{&SteadyClock::instance()} {}
+
+    /**
+     * Sets the clock timers follow, usually that of the nodes the loop
+     * drives (see Node::setClock). With a virtual clock, the loop jumps
+     * to the earliest timer whenever no coroutine is ready. Set it
+     * before spawning tasks.
+     * \param _clock Clock, which must outlive the loop.
+     */
+    void setClock(Clock* _clock) {
+        clock = _clock;
+    }
+
+    /**
+     * Schedules a top-level task. It starts on the next run().
+     * \param task Task to be run.
+     */
+    void spawn(Task task) {
+        task.handle.promise().owner = this;
+        post(task.handle);
+        tasks.push_back(std::move(task));
+        remaining++;
+    }
+
+    /**
+     * Runs until every spawned task finishes, rethrowing the first
+     * exception one of them threw.
+     */
+    void run() {
+        while (remaining > 0 && !error) {
+            next().resume();
+        }
+
+        tasks.clear();
+        remaining = 0;
+
+        if (error) {
+            std::exception_ptr e = error;
+            error = nullptr;
+            std::rethrow_exception(e);
+        }
+    }
+
+    /**
+     * Queues a coroutine to be resumed. Safe to call from any thread.
+     * \param h Suspended coroutine.
+     */
+    void post(std::coroutine_handle<> h) {
+        std::lock_guard<std::mutex> lock(mtx);
+        ready.push_back(h);
+        cv.notify_one();
+    }
+
+    /**
+     * Awaitable that suspends the caller for a while without
+     * blocking the loop.
+     * \param duration Time to sleep.
+     */
+    template <typename Rep, typename Period>
+    auto sleep(std::chrono::duration<Rep, Period> duration) {
+        struct Awaiter {
+            EventLoop* loop;
+            Clock::time_point deadline;
+
+            bool await_ready() {
+                return loop->clock->now() >= deadline;
+            }
+
+            void await_suspend(std::coroutine_handle<> h) {
+                std::lock_guard<std::mutex> lock(loop->mtx);
+                loop->timers.emplace(deadline, h);
+                loop->cv.notify_one();
+            }
+
+            void await_resume() {}
+        };
+
+        const auto delay = std::chrono::duration_cast<Clock::time_point::duration>(duration);
+        return Awaiter{this, clock->now() + delay};
+    }
+
+    /**
+     * Awaitable that suspends the caller until the transport has a
+     * message, so that the following Transport::recv() won't block.
+     * \param transport Transport to wait on.
+     */
+    auto readable(Transport& transport) {
+        struct Awaiter {
+            EventLoop* loop;
+            Transport* transport;
+
+            bool await_ready() {
+                return false;
+            }
+
+            void await_suspend(std::coroutine_handle<> h) {
+                EventLoop* l = loop;
+                transport->recvAsync([l, h]() { l->post(h); });
+            }
+
+            void await_resume() {}
+        };
+
+        return Awaiter{this, &transport};
+    }
+
+private:
+    /**
+     * Takes the next coroutine to be resumed, blocking until there is one.
+     */
+    std::coroutine_handle<> next() {
+        std::unique_lock<std::mutex> lock(mtx);
+
+        for (;;) {
+            if (!timers.empty() && timers.begin()->first <= clock->now()) {
+                const std::coroutine_handle<> h = timers.begin()->second;
+                timers.erase(timers.begin());
+                return h;
+            }
+
+            if (!ready.empty()) {
+                const std::coroutine_handle<> h = ready.front();
+                ready.pop_front();
+                return h;
+            }
+
+            if (timers.empty()) {
+                cv.wait(lock);
+            }
+            else if (clock->isVirtual()) {
+                clock->sleepUntil(timers.begin()->first);
+            }
+            else {
+                cv.wait_until(lock, timers.begin()->first);
+            }
+        }
+    }
+
+    /**
+     * Called when a spawned task finishes.
+     * \param e Exception it threw, if any.
+     */
+    void finished(std::exception_ptr e) {
+        remaining--;
+        if (e && !error) {
+            error = e;
+        }
+    }
+
+    friend struct Task::promise_type::FinalAwaiter;
+};
+
+inline std::coroutine_handle<> Task::promise_type::FinalAwaiter::await_suspend(std::coroutine_handle<promise_type> h) noexcept {
+    promise_type& p = h.promise();
+
+    if (p.continuation) {
+        return p.continuation;
+    }
+    if (p.owner != nullptr) {
+        p.owner->finished(p.error);
+    }
+    return std::noop_coroutine();
+}
+
+}
+
+#endif // PAIRSIM_EVENT_LOOP_HPP_
@@ -0,0 +1,228 @@
+
+#ifndef PAIRSIM_FOOTPRINT_HPP_
+#define PAIRSIM_FOOTPRINT_HPP_
+
+// Standard lib utilities
+#include <cstddef>
+#include <cstdio>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+// JSON handling
+#include <json.hpp>
+using json = nlohmann::json;
+
+namespace ps {
+
+/**
+ * Estimates of the heap memory held by standard containers, for sizing
+ * nodes. They count what the containers ask the allocator for, as laid
+ * out by libstdc++, not the allocator's own overhead.
+ */
+namespace memory {
+
+/**
+ * Heap bytes of a string, 0 when it fits in the string itself.
+ * \param s String.
+ * \returns Bytes.
+ */
+inline std::size_t heap(const std::string& s) {
+    const char* self = (const char*) &s;
+    if (s.data() >= self && s.data() < self + sizeof(s)) {
+        return 0;
+    }
+    return s.capacity() + 1;
+}
+
+/**
+ * Heap bytes of a vector's elements, not counting what the elements
+ * themselves hold.
+ * \param v Vector.
+ * \returns Bytes.
+ */
+template <typename T>
+std::size_t heap(const std::vector<T>& v) {
+    return v.capacity() * sizeof(T);
+}
+
+/**
+ * Heap bytes of a vector of strings, counting the strings' own.
+ * \param v Vector.
+ * \returns Bytes.
+ */
+inline std::size_t heap(const std::vector<std::string>& v) {
+    std::size_t bytes = v.capacity() * sizeof(std::string);
+    for (const std::string& s : v) {
+        bytes += heap(s);
+    }
+    return bytes;
+}
+
+/**
+ * Heap bytes of a JSON value, counting its whole tree.
+ * \param j Value.
+ * \returns Bytes.
+ */
+inline std::size_t heap(const json& j) {
+    std::size_t bytes = 0;
+
+    switch (j.type()) {
+        case json::value_t::object:
+            bytes += sizeof(json::object_t);
+            for (auto it = j.begin(); it != j.end(); ++it) {
+                // red-black tree node: color and three links, then the pair
+                bytes += 4 * sizeof(void*) + sizeof(std::pair<const std::string, json>);
+                bytes += heap(it.key()) + heap(it.value());
+            }
+            break;
+        case json::value_t::array: {
+            const json::array_t& a = j.get_ref<const json::array_t&>();
+            bytes += sizeof(json::array_t) + a.capacity() * sizeof(json);
+            for (const json& e : a) {
+                bytes += heap(e);
+            }
+            break;
+        }
+        case json::value_t::string:
+            bytes += sizeof(json::string_t) + heap(j.get_ref<const json::string_t&>());
+            break;
+        case json::value_t::binary:
+            bytes += sizeof(json::binary_t) + j.get_binary().capacity();
+            break;
+        default:
+            break;
+    }
+
+    return bytes;
+}
+
+/**
+ * Heap bytes of one std::map node.
+ * \returns Bytes.
+ */
+template <typename K, typename V>
+constexpr std::size_t mapNode() {
+    return 4 * sizeof(void*) + sizeof(std::pair<const K, V>);
+}
+
+/**
+ * Heap bytes of one std::unordered_map node, its bucket array aside.
+ * \returns Bytes.
+ */
+template <typename K, typename V>
+constexpr std::size_t hashNode() {
+    return 2 * sizeof(void*) + sizeof(std::pair<const K, V>);
+}
+
+/**
+ * Bytes of a shared_ptr's control block, assuming it was made with
+ * std::make_shared: a vtable pointer and the two counts.
+ * \returns Bytes.
+ */
+template <typename T>
+constexpr std::size_t controlBlock(const std::shared_ptr<T>&) {
+    return sizeof(void*) + 2 * sizeof(int);
+}
+
+/**
+ * Other device pointers have no control block.
+ * \returns 0.
+ */
+template <typename T>
+constexpr std::size_t controlBlock(const T&) {
+    return 0;
+}
+
+}
+
+/**
+ * Memory held by the devices of one type.
+ */
+struct DeviceTypeFootprint {
+    std::size_t devices;
+
+    /** Device objects, their control blocks and registry entries. */
+    std::size_t bytes;
+};
+
+/**
+ * Memory a node holds, by component, see Node::memoryFootprint. All
+ * values are in bytes.
+ */
+struct MemoryFootprint {
+    /** The node object itself, counters and histograms included. */
+    std::size_t node;
+
+    /** Device list and the by type and ID map. */
+    std::size_t registry;
+
+    /** Device objects, see Device::memoryUsage. Includes the last state
+     * sent, kept for change thresholds. */
+    std::size_t devices;
+
+    /** shared_ptr control blocks of the devices. */
+    std::size_t controlBlocks;
+
+    /** Queued packets and their buffers. */
+    std::size_t queue;
+
+    /** Action callbacks by name, not counting what the callbacks
+     * capture beyond std::function's own storage. */
+    std::size_t actions;
+
+    /** Subscriptions, spatial index, interest, dead reckoning and traffic
+     * accounting state, the trace buffer and hardware counters. */
+    std::size_t caches;
+
+    /** By device type. */
+    std::map<std::string, DeviceTypeFootprint> deviceTypes;
+
+    /**
+     * Gets the total.
+     * \returns Bytes.
+     */
+    std::size_t total() const {
+        return node + registry + devices + controlBlocks + queue + actions + caches;
+    }
+
+    /**
+     * Writes the footprint as a table, with bytes per device for each
+     * device type.
+     * \param out Stream to write to.
+     */
+    void report(std::ostream& out) const {
+        const std::pair<const char*, std::size_t> components[] = {
+            {"node", node},
+            {"registry", registry},
+            {"devices", devices},
+            {"control blocks", controlBlocks},
+            {"queue", queue},
+            {"actions", actions},
+            {"caches", caches},
+            {"total", total()},
+        };
+
+        char line[96];
+        for (const auto& c : components) {
+            std::snprintf(line, sizeof(line), "%-20s %14zu\n", c.first, c.second);
+            out << line;
+        }
+
+        std::snprintf(line, sizeof(line), "%-20s %10s %14s %12s\n", "device type", "devices", "bytes", "bytes/device");
+        out << line;
+        for (const auto& t : deviceTypes) {
+            std::snprintf(line, sizeof(line), "%-20.20s %10zu %14zu %12.1f\n", t.first.c_str(), t.second.devices,
+                          t.second.bytes, t.second.devices > 0 ? (double) t.second.bytes / t.second.devices : 0);
+            out << line;
+        }
+    }
+};
+
+}
+
+#endif // PAIRSIM_FOOTPRINT_HPP_
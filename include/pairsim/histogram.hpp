@@ -0,0 +1,208 @@
+
+#ifndef PAIRSIM_HISTOGRAM_HPP_
+#define PAIRSIM_HISTOGRAM_HPP_
+
+// Standard lib utilities
+#include <atomic>
+#include <cstdint>
+#include <limits>
+
+namespace ps {
+
+/**
+ * Lock-free log-linear histogram, in the spirit of HdrHistogram: every
+ * power of two is split into 16 linear sub-buckets, so any recorded
+ * value is reported within ~6% of its true value, from 1 up to 2^48.
+ *
+ * Recording is a handful of relaxed atomic increments and may happen on
+ * one thread while others query; queries see a slightly stale but
+ * consistent-enough view, which is fine for monitoring.
+ */
+class Histogram {
+public:
+    /** Sub-buckets per power of two, as a bit count. */
+    static constexpr int SUB_BITS = 4;
+
+    /** Values are clamped below 2^MAX_BITS. */
+    static constexpr int MAX_BITS = 48;
+
+    /** Number of buckets. */
+    static constexpr int BUCKETS = (MAX_BITS - SUB_BITS + 1) << SUB_BITS;
+
+private:
+    std::atomic<std::uint64_t> buckets[BUCKETS];
+    std::atomic<std::uint64_t> samples;
+    std::atomic<std::uint64_t> valueSum;
+    std::atomic<std::uint64_t> lowest;
+    std::atomic<std::uint64_t> highest;
+
+public:
+    /**
+     * Creates an empty histogram.
+     */
+    Histogram() {
+        reset();
+    }
+
+    Histogram(const Histogram& rhs) = delete;
+    Histogram& operator=(const Histogram& rhs) = delete;
+
+    /**
+     * Records a value.
+     * \param value Value, e.g. a duration in ns.
+     */
+    void record(std::uint64_t value) {
+        const std::uint64_t limit = (std::uint64_t(1) << MAX_BITS) - 1;
+        if (value > limit) {
+            value = limit;
+        }
+
+        buckets[indexOf(value)].fetch_add(1, std::memory_order_relaxed);
+        samples.fetch_add(1, std::memory_order_relaxed);
+        valueSum.fetch_add(value, std::memory_order_relaxed);
+
+        std::uint64_t current = lowest.load(std::memory_order_relaxed);
+        while (value < current && !lowest.compare_exchange_weak(current, value, std::memory_order_relaxed)) {}
+
+        current = highest.load(std::memory_order_relaxed);
+        while (value > current && !highest.compare_exchange_weak(current, value, std::memory_order_relaxed)) {}
+    }
+
+    /**
+     * Clears every recorded value.
+     */
+    void reset() {
+        for (int i = 0; i < BUCKETS; i++) {
+            buckets[i].store(0, std::memory_order_relaxed);
+        }
+        samples.store(0, std::memory_order_relaxed);
+        valueSum.store(0, std::memory_order_relaxed);
+        lowest.store(std::numeric_limits<std::uint64_t>::max(), std::memory_order_relaxed);
+        highest.store(0, std::memory_order_relaxed);
+    }
+
+    /**
+     * Gets the number of recorded values.
+     * \returns Value count.
+     */
+    std::uint64_t count() const {
+        return samples.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * Gets the smallest recorded value.
+     * \returns Minimum, 0 if empty.
+     */
+    std::uint64_t min() const {
+        return count() == 0 ? 0 : lowest.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * Gets the largest recorded value.
+     * \returns Maximum, 0 if empty.
+     */
+    std::uint64_t max() const {
+        return highest.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * Gets the sum of the recorded values.
+     * \returns Sum.
+     */
+    std::uint64_t sum() const {
+        return valueSum.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * Counts the recorded values up to a bound, e.g. for the cumulative
+     * buckets of a Prometheus histogram. Values sharing the bound's
+     * bucket are counted in as well.
+     * \param value Bound.
+     * \returns Value count.
+     */
+    std::uint64_t countAtMost(std::uint64_t value) const {
+        const std::uint64_t limit = (std::uint64_t(1) << MAX_BITS) - 1;
+        const int last = indexOf(value < limit ? value : limit);
+
+        std::uint64_t n = 0;
+        for (int i = 0; i <= last; i++) {
+            n += buckets[i].load(std::memory_order_relaxed);
+        }
+        return n;
+    }
+
+    /**
+     * Gets the mean of the recorded values.
+     * \returns Mean, 0 if empty.
+     */
+    double mean() const {
+        const std::uint64_t n = count();
+        return n == 0 ? 0 : (double) valueSum.load(std::memory_order_relaxed) / n;
+    }
+
+    /**
+     * Gets a percentile of the recorded values.
+     * \param p Percentile, from 0 to 100.
+     * \returns Highest value equivalent to the percentile, 0 if empty.
+     */
+    std::uint64_t percentile(double p) const {
+        std::uint64_t n = 0;
+        std::uint64_t counts[BUCKETS];
+        for (int i = 0; i < BUCKETS; i++) {
+            counts[i] = buckets[i].load(std::memory_order_relaxed);
+            n += counts[i];
+        }
+        if (n == 0) {
+            return 0;
+        }
+
+        const double clamped = p < 0 ? 0 : (p > 100 ? 100 : p);
+        std::uint64_t rank = (std::uint64_t) (clamped / 100 * n + 0.5);
+        if (rank == 0) {
+            rank = 1;
+        }
+
+        std::uint64_t seen = 0;
+        for (int i = 0; i < BUCKETS; i++) {
+            seen += counts[i];
+            if (seen >= rank) {
+                const std::uint64_t top = highestIn(i);
+                return top < max() ? top : max();
+            }
+        }
+        return max();
+    }
+
+private:
+    /**
+     * Bucket holding a value.
+     */
+    static int indexOf(std::uint64_t value) {
+        if (value < (std::uint64_t(1) << SUB_BITS)) {
+            return (int) value;
+        }
+
+        const int exponent = 63 - __builtin_clzll(value);
+        const int shift = exponent - SUB_BITS;
+        const int sub = (int) (value >> shift) & ((1 << SUB_BITS) - 1);
+        return ((shift + 1) << SUB_BITS) + sub;
+    }
+
+    /**
+     * Largest value that falls in a bucket.
+     */
+    static std::uint64_t highestIn(int index) {
+        if (index < (1 << SUB_BITS)) {
+            return index;
+        }
+
+        const int shift = (index >> SUB_BITS) - 1;
+        const std::uint64_t sub = index & ((1 << SUB_BITS) - 1);
+        const std::uint64_t low = ((std::uint64_t(1) << SUB_BITS) + sub) << shift;
+        return low + (std::uint64_t(1) << shift) - 1;
+    }
+};
+
+}
+
+#endif // PAIRSIM_HISTOGRAM_HPP_
@@ -0,0 +1,211 @@
+
+#ifndef PAIRSIM_LOCAL_TRANSPORT_HPP_
+#define PAIRSIM_LOCAL_TRANSPORT_HPP_
+
+// Standard lib utilities
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+
+// Internal classes
+#include "transport.hpp"
+
+namespace ps {
+
+/**
+ * In-process transport, selected with "local://name" addresses, for
+ * client and server models linked into the same executable.
+ *
+ * Besides plain messages it carries device handovers: instead of
+ * serializing a device, the sender passes a pointer to it and the
+ * receiver copies the state over with Device::copyFrom. The pointer is
+ * read when the receiver handles it, which is safe as long as the sender
+ * leaves its devices alone until it gets the peer's TICK back, as the
+ * regular tick loop does.
+ */
+class LocalTransport : public Transport {
+public:
+    /** Address prefix that selects this transport. */
+    static constexpr const char* SCHEME = "local://";
+
+private:
+    /** Queued message or device handover. */
+    struct Envelope {
+        Buffer buf;
+        Device* device;
+    };
+
+    /** One direction of a channel. */
+    struct Queue {
+        std::mutex mtx;
+        std::condition_variable cv;
+        std::deque<Envelope> items;
+        bool closed = false;
+        std::function<void()> waiter;
+    };
+
+    /** Both directions of a listener/dialer pair. */
+    struct Channel {
+        Queue toListener;
+        Queue toDialer;
+    };
+
+    /** Channel name, as given in the address. */
+    std::string name;
+
+    /** Channel shared with the peer. */
+    std::shared_ptr<Channel> channel;
+
+    /** Queue this side writes to. */
+    Queue* out;
+
+    /** Queue this side reads from. */
+    Queue* in;
+
+    /** Whether this side registered the channel. */
+    bool owner;
+
+    /** Last received envelope, kept alive until the next recv(). */
+    Envelope last;
+
+public:
+    /**
+     * Creates a local transport, only initializes members.
+     */
+    LocalTransport() : name{""}, channel{nullptr}, out{nullptr}, in{nullptr}, owner{false}, last{Buffer(), nullptr} {}
+
+    /**
+     * Destroys the transport, waking a blocked peer.
+     */
+    ~LocalTransport() {
+        if (out != nullptr) {
+            std::unique_lock<std::mutex> lock(out->mtx);
+            out->closed = true;
+            out->cv.notify_all();
+            notifyWaiter(*out, lock);
+        }
+        if (owner) {
+            std::lock_guard<std::mutex> lock(registryMutex());
+            registry().erase(name);
+        }
+    }
+
+    void listen(const std::string& address) {
+        name = address.substr(std::string(SCHEME).size());
+        channel = std::make_shared<Channel>();
+
+        std::lock_guard<std::mutex> lock(registryMutex());
+        if (!registry().emplace(name, channel).second) {
+            throw std::runtime_error("local address already in use: " + address);
+        }
+
+        owner = true;
+        out = &channel->toDialer;
+        in = &channel->toListener;
+    }
+
+    void dial(const std::string& address) {
+        name = address.substr(std::string(SCHEME).size());
+
+        std::lock_guard<std::mutex> lock(registryMutex());
+        const auto it = registry().find(name);
+        if (it == registry().end()) {
+            throw std::runtime_error("no local listener at " + address);
+        }
+
+        channel = it->second;
+        out = &channel->toListener;
+        in = &channel->toDialer;
+    }
+
+    void send(const std::uint8_t* data, std::size_t size) {
+        push(Envelope{Buffer(data, data + size), nullptr});
+    }
+
+    bool direct() {
+        return true;
+    }
+
+    void sendDevice(Device* device) {
+        push(Envelope{Buffer(), device});
+    }
+
+    BufferView recv() {
+        std::unique_lock<std::mutex> lock(in->mtx);
+        in->cv.wait(lock, [this]() { return !in->items.empty() || in->closed; });
+
+        if (in->items.empty()) {
+            throw std::runtime_error("local peer closed");
+        }
+
+        last = std::move(in->items.front());
+        in->items.pop_front();
+
+        return BufferView{last.buf.data(), last.buf.size()};
+    }
+
+    void recvAsync(std::function<void()> done) {
+        std::unique_lock<std::mutex> lock(in->mtx);
+        in->waiter = std::move(done);
+        if (!in->items.empty() || in->closed) {
+            notifyWaiter(*in, lock);
+        }
+    }
+
+    Device* receivedDevice() {
+        return last.device;
+    }
+
+private:
+    /**
+     * Appends an envelope to the outgoing queue.
+     * \param e Envelope to be sent.
+     */
+    void push(Envelope&& e) {
+        std::unique_lock<std::mutex> lock(out->mtx);
+        out->items.push_back(std::move(e));
+        out->cv.notify_one();
+        notifyWaiter(*out, lock);
+    }
+
+    /**
+     * Calls the pending asynchronous receive callback, if any, outside
+     * of the queue lock.
+     * \param q Queue that became readable.
+     * \param lock Held lock on q, released here.
+     */
+    static void notifyWaiter(Queue& q, std::unique_lock<std::mutex>& lock) {
+        std::function<void()> waiter = std::move(q.waiter);
+        q.waiter = nullptr;
+        lock.unlock();
+
+        if (waiter) {
+            waiter();
+        }
+    }
+
+    /**
+     * Listening channels by name.
+     */
+    static std::map<std::string, std::shared_ptr<Channel>>& registry() {
+        static std::map<std::string, std::shared_ptr<Channel>> channels;
+        return channels;
+    }
+
+    /**
+     * Guards registry().
+     */
+    static std::mutex& registryMutex() {
+        static std::mutex mtx;
+        return mtx;
+    }
+};
+
+}
+
+#endif // PAIRSIM_LOCAL_TRANSPORT_HPP_
@@ -0,0 +1,518 @@
+
+#ifndef PAIRSIM_LOGGER_HPP_
+#define PAIRSIM_LOGGER_HPP_
+
+// Standard lib utilities
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace ps {
+
+/** Log levels, from most to least verbose. */
+enum LogLevel : std::uint8_t {
+    LOG_TRACE = 0,
+    LOG_DEBUG = 1,
+    LOG_INFO = 2,
+    LOG_WARN = 3,
+    LOG_ERROR = 4,
+    LOG_OFF = 5,
+};
+
+// Least verbose level compiled in; calls below it are removed entirely.
+// Defining PAIRSIM_DEBUG_ENABLED compiles in debug logs.
+#ifndef PAIRSIM_LOG_LEVEL
+#ifdef PAIRSIM_DEBUG_ENABLED
+#define PAIRSIM_LOG_LEVEL 1
+#else
+#define PAIRSIM_LOG_LEVEL 2
+#endif
+#endif
+
+/**
+ * Log argument handed over whole rather than copied into the entry, e.g.
+ * a packet dump. Costs an allocation, so it is meant for long and rare
+ * strings.
+ */
+struct LogText {
+    std::string text;
+};
+
+/**
+ * Asynchronous logger. Each thread writes compact binary entries (a
+ * timestamp, the static format string and the raw arguments) into its
+ * own lock-free ring, and a background thread formats them and writes
+ * them out. Logging thus costs a clock read and a few stores; when a
+ * ring is full, entries are dropped and counted rather than blocking.
+ *
+ * Format strings use "{}" for each argument and must outlive the
+ * process, i.e. be string literals. Arguments can be integers, enums,
+ * floating point numbers and strings; strings are copied, and truncated
+ * to what fits in an entry, which shows as "... (N more bytes)". Long
+ * strings that must be kept whole go in a LogText.
+ */
+class Logger {
+public:
+    /** Entries per thread ring. */
+    static constexpr std::size_t RING_SIZE = 2048;
+
+    /** Arguments per entry. */
+    static constexpr std::size_t MAX_ARGS = 6;
+
+    /** Bytes per entry for copied strings. */
+    static constexpr std::size_t TEXT_SIZE = 176;
+
+private:
+    enum Kind : std::uint8_t {
+        SIGNED,
+        UNSIGNED,
+        FLOATING,
+        STRING,
+        TEXT,
+    };
+
+    union Value {
+        std::int64_t i;
+        std::uint64_t u;
+        double d;
+
+        /** Offset and length in the entry's text, and bytes cut off. */
+        struct {
+            std::uint16_t offset;
+            std::uint16_t size;
+            std::uint32_t cut;
+        } s;
+
+        /** Handed over string, freed once written. */
+        std::string* text;
+    };
+
+    struct Entry {
+        std::uint64_t time;
+        const char* format;
+        LogLevel level;
+        std::uint8_t argc;
+        std::uint16_t textSize;
+        Kind kinds[MAX_ARGS];
+        Value args[MAX_ARGS];
+        char text[TEXT_SIZE];
+    };
+
+    /**
+     * Single producer, single consumer ring of one thread's entries.
+     */
+    struct Ring {
+        Entry entries[RING_SIZE];
+        alignas(64) std::atomic<std::uint64_t> head{0};
+        alignas(64) std::atomic<std::uint64_t> tail{0};
+        std::atomic<std::uint64_t> dropped{0};
+
+        /** Drops already reported, only used by the background thread. */
+        std::uint64_t reported{0};
+
+        /** Whether the thread writing it exited. */
+        std::atomic<bool> closed{false};
+    };
+
+    /**
+     * Registers the calling thread's ring and closes it when the thread
+     * exits, leaving the rest to be written by the background thread.
+     */
+    struct RingHandle {
+        std::shared_ptr<Ring> ring;
+
+        RingHandle() : ring{std::make_shared<Ring>()} {
+            instance().attach(ring);
+        }
+
+        ~RingHandle() {
+            ring->closed.store(true, std::memory_order_release);
+        }
+    };
+
+    std::atomic<int> level;
+    std::atomic<std::uint32_t> packetSampling;
+    std::chrono::steady_clock::time_point start;
+
+    /** Guards rings and output. */
+    std::mutex mutex;
+    std::vector<std::shared_ptr<Ring>> rings;
+    FILE* out;
+
+    std::atomic<bool> running;
+    std::thread writer;
+
+    Logger() : level{PAIRSIM_LOG_LEVEL}, packetSampling{64}, start{std::chrono::steady_clock::now()},
+               out{stdout}, running{false} {}
+
+public:
+    Logger(const Logger& rhs) = delete;
+    Logger& operator=(const Logger& rhs) = delete;
+
+    /**
+     * Stops the background thread, writing what is left.
+     */
+    ~Logger() {
+        if (running.exchange(false)) {
+            writer.join();
+        }
+        drain();
+    }
+
+    /**
+     * Gets the logger.
+     * \returns Process-wide logger.
+     */
+    static Logger& instance() {
+        static Logger logger;
+        return logger;
+    }
+
+    /**
+     * Sets the least verbose level logged. Levels below PAIRSIM_LOG_LEVEL
+     * are compiled out and can't be enabled.
+     * \param _level Level.
+     */
+    static void setLevel(LogLevel _level) {
+        instance().level.store(_level, std::memory_order_relaxed);
+    }
+
+    /**
+     * Checks whether a level is logged.
+     * \param _level Level.
+     * \returns Whether entries of that level are kept.
+     */
+    static bool enabled(LogLevel _level) {
+        return _level >= instance().level.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * Sets how often received packets are dumped whole at debug level;
+     * the rest only log their type.
+     * \param every Dump one packet in this many, 0 for never.
+     */
+    static void setPacketSampling(std::uint32_t every) {
+        instance().packetSampling.store(every, std::memory_order_relaxed);
+    }
+
+    /**
+     * Decides whether to dump the calling thread's next received packet.
+     * \returns Whether to dump it.
+     */
+    static bool samplePacket() {
+        static thread_local std::uint32_t count = 0;
+        const std::uint32_t every = instance().packetSampling.load(std::memory_order_relaxed);
+        return every > 0 && count++ % every == 0;
+    }
+
+    /**
+     * Sets where entries are written, stdout by default.
+     * \param _out Open file, owned by the caller.
+     */
+    static void setOutput(FILE* _out) {
+        Logger& logger = instance();
+        std::lock_guard<std::mutex> lock{logger.mutex};
+        std::fflush(logger.out);
+        logger.out = _out;
+    }
+
+    /**
+     * Waits until every entry logged so far is written out.
+     */
+    static void flush() {
+        Logger& logger = instance();
+        logger.drain();
+        std::lock_guard<std::mutex> lock{logger.mutex};
+        std::fflush(logger.out);
+    }
+
+    /**
+     * Logs an entry, see the PAIRSIM_LOG_* macros.
+     * \param _level Level.
+     * \param format Format string, with "{}" for each argument. Must be
+     * a string literal.
+     * \param args Arguments, up to MAX_ARGS.
+     */
+    template <typename... Args>
+    static void write(LogLevel _level, const char* format, Args&&... args) {
+        static_assert(sizeof...(Args) <= MAX_ARGS, "Too many log arguments");
+        Ring& ring = localRing();
+
+        const std::uint64_t head = ring.head.load(std::memory_order_relaxed);
+        if (head - ring.tail.load(std::memory_order_acquire) >= RING_SIZE) {
+            ring.dropped.store(ring.dropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            return;
+        }
+
+        Entry& e = ring.entries[head % RING_SIZE];
+        e.time = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - instance().start).count();
+        e.format = format;
+        e.level = _level;
+        e.argc = 0;
+        e.textSize = 0;
+        int expand[] = {0, (put(e, std::forward<Args>(args)), 0)...};
+        (void) expand;
+
+        ring.head.store(head + 1, std::memory_order_release);
+    }
+
+private:
+    /**
+     * Gets the calling thread's ring, creating it on first use.
+     */
+    static Ring& localRing() {
+        static thread_local RingHandle handle;
+        return *handle.ring;
+    }
+
+    /**
+     * Registers a thread's ring, starting the background thread with the
+     * first one.
+     */
+    void attach(const std::shared_ptr<Ring>& ring) {
+        std::lock_guard<std::mutex> lock{mutex};
+        rings.push_back(ring);
+        if (!running.exchange(true)) {
+            writer = std::thread([this]() { run(); });
+        }
+    }
+
+    void run() {
+        while (running.load(std::memory_order_relaxed)) {
+            if (!drain()) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(2));
+            }
+        }
+    }
+
+    /**
+     * Writes every pending entry, in time order, and forgets the rings of
+     * exited threads once empty.
+     * \returns Whether anything was written.
+     */
+    bool drain() {
+        std::lock_guard<std::mutex> lock{mutex};
+        bool wrote = false;
+
+        std::vector<std::uint64_t> heads;
+        std::vector<Entry*> pending;
+        for (const auto& ring : rings) {
+            const std::uint64_t head = ring->head.load(std::memory_order_acquire);
+            for (std::uint64_t i = ring->tail.load(std::memory_order_relaxed); i < head; i++) {
+                pending.push_back(&ring->entries[i % RING_SIZE]);
+            }
+            heads.push_back(head);
+
+            const std::uint64_t dropped = ring->dropped.load(std::memory_order_relaxed);
+            if (dropped > ring->reported) {
+                std::fprintf(out, "[PS] %llu log entries dropped\n", (unsigned long long) (dropped - ring->reported));
+                ring->reported = dropped;
+                wrote = true;
+            }
+        }
+
+        std::stable_sort(pending.begin(), pending.end(), [](const Entry* a, const Entry* b) {
+            return a->time < b->time;
+        });
+
+        std::string line;
+        for (Entry* e : pending) {
+            format(*e, line);
+            std::fwrite(line.data(), 1, line.size(), out);
+            release(*e);
+        }
+        if (!pending.empty()) {
+            std::fflush(out);
+            wrote = true;
+        }
+
+        // entries are only handed back to their threads once written
+        for (std::size_t i = 0; i < rings.size(); i++) {
+            rings[i]->tail.store(heads[i], std::memory_order_release);
+        }
+        rings.erase(std::remove_if(rings.begin(), rings.end(), [](const std::shared_ptr<Ring>& ring) {
+            return ring->closed.load(std::memory_order_acquire)
+                && ring->tail.load(std::memory_order_relaxed) == ring->head.load(std::memory_order_acquire);
+        }), rings.end());
+
+        return wrote;
+    }
+
+    /**
+     * Formats an entry into a line.
+     */
+    static void format(const Entry& e, std::string& line) {
+        static const char levels[] = "TDIWE";
+        char prefix[48];
+        std::snprintf(prefix, sizeof(prefix), "[PS] %llu.%06llu %c ", (unsigned long long) (e.time / 1000000000),
+                      (unsigned long long) (e.time / 1000 % 1000000), levels[e.level < LOG_OFF ? e.level : 0]);
+        line = prefix;
+
+        std::size_t arg = 0;
+        for (const char* c = e.format; *c; c++) {
+            if (c[0] == '{' && c[1] == '}' && arg < e.argc) {
+                append(e, arg++, line);
+                c++;
+            }
+            else {
+                line += *c;
+            }
+        }
+        line += '\n';
+    }
+
+    static void append(const Entry& e, std::size_t i, std::string& line) {
+        char number[32];
+        switch (e.kinds[i]) {
+            case SIGNED:
+                std::snprintf(number, sizeof(number), "%lld", (long long) e.args[i].i);
+                line += number;
+                break;
+            case UNSIGNED:
+                std::snprintf(number, sizeof(number), "%llu", (unsigned long long) e.args[i].u);
+                line += number;
+                break;
+            case FLOATING:
+                std::snprintf(number, sizeof(number), "%g", e.args[i].d);
+                line += number;
+                break;
+            case STRING:
+                line.append(e.text + e.args[i].s.offset, e.args[i].s.size);
+                if (e.args[i].s.cut > 0) {
+                    std::snprintf(number, sizeof(number), "... (%u more bytes)", (unsigned) e.args[i].s.cut);
+                    line += number;
+                }
+                break;
+            case TEXT:
+                line += *e.args[i].text;
+                break;
+        }
+    }
+
+    /**
+     * Frees the strings an entry was handed, once written.
+     */
+    static void release(Entry& e) {
+        for (std::size_t i = 0; i < e.argc; i++) {
+            if (e.kinds[i] == TEXT) {
+                delete e.args[i].text;
+            }
+        }
+    }
+
+    template <typename T>
+    static typename std::enable_if<std::is_integral<T>::value && std::is_signed<T>::value>::type
+    put(Entry& e, const T& value) {
+        e.kinds[e.argc] = SIGNED;
+        e.args[e.argc++].i = value;
+    }
+
+    template <typename T>
+    static typename std::enable_if<(std::is_integral<T>::value && !std::is_signed<T>::value)
+                                   || std::is_enum<T>::value>::type
+    put(Entry& e, const T& value) {
+        e.kinds[e.argc] = UNSIGNED;
+        e.args[e.argc++].u = (std::uint64_t) value;
+    }
+
+    template <typename T>
+    static typename std::enable_if<std::is_floating_point<T>::value>::type
+    put(Entry& e, const T& value) {
+        e.kinds[e.argc] = FLOATING;
+        e.args[e.argc++].d = value;
+    }
+
+    static void put(Entry& e, const char* value) {
+        putString(e, value, std::strlen(value));
+    }
+
+    static void put(Entry& e, const std::string& value) {
+        putString(e, value.data(), value.size());
+    }
+
+    static void put(Entry& e, LogText&& value) {
+        e.kinds[e.argc] = TEXT;
+        e.args[e.argc++].text = new std::string(std::move(value.text));
+    }
+
+    /**
+     * Copies a string into the entry, truncating it to the room left.
+     */
+    static void putString(Entry& e, const char* value, std::size_t size) {
+        const std::size_t n = std::min(size, TEXT_SIZE - e.textSize);
+        std::memcpy(e.text + e.textSize, value, n);
+
+        e.kinds[e.argc] = STRING;
+        e.args[e.argc].s.offset = e.textSize;
+        e.args[e.argc].s.size = n;
+        e.args[e.argc++].s.cut = size - n;
+        e.textSize += n;
+    }
+};
+
+}
+
+#define PAIRSIM_LOG_(level, ...) \
+    do { if (ps::Logger::enabled(level)) { ps::Logger::write(level, __VA_ARGS__); } } while (0)
+
+// Per level logging, e.g. PAIRSIM_LOG_DEBUG("Adding device {}", id)
+#if PAIRSIM_LOG_LEVEL <= 0
+#define PAIRSIM_LOG_TRACE(...) PAIRSIM_LOG_(ps::LOG_TRACE, __VA_ARGS__)
+#else
+#define PAIRSIM_LOG_TRACE(...) do {} while (0)
+#endif
+
+#if PAIRSIM_LOG_LEVEL <= 1
+#define PAIRSIM_LOG_DEBUG(...) PAIRSIM_LOG_(ps::LOG_DEBUG, __VA_ARGS__)
+#else
+#define PAIRSIM_LOG_DEBUG(...) do {} while (0)
+#endif
+
+#if PAIRSIM_LOG_LEVEL <= 2
+#define PAIRSIM_LOG_INFO(...) PAIRSIM_LOG_(ps::LOG_INFO, __VA_ARGS__)
+#else
+#define PAIRSIM_LOG_INFO(...) do {} while (0)
+#endif
+
+#if PAIRSIM_LOG_LEVEL <= 3
+#define PAIRSIM_LOG_WARN(...) PAIRSIM_LOG_(ps::LOG_WARN, __VA_ARGS__)
+#else
+#define PAIRSIM_LOG_WARN(...) do {} while (0)
+#endif
+
+#if PAIRSIM_LOG_LEVEL <= 4
+#define PAIRSIM_LOG_ERROR(...) PAIRSIM_LOG_(ps::LOG_ERROR, __VA_ARGS__)
+#else
+#define PAIRSIM_LOG_ERROR(...) do {} while (0)
+#endif
+
+// Logs a received packet at debug level, dumping a sample of them whole
+// (see Logger::setPacketSampling), however long
+#if PAIRSIM_LOG_LEVEL <= 1
+#define PAIRSIM_LOG_PACKET(type, msg) \
+    do { \
+        if (ps::Logger::enabled(ps::LOG_DEBUG)) { \
+            if (ps::Logger::samplePacket()) { \
+                ps::Logger::write(ps::LOG_DEBUG, "Received {}: {}", ps::packetName(type), ps::LogText{(msg).dump()}); \
+            } \
+            else { \
+                ps::Logger::write(ps::LOG_DEBUG, "Received {}", ps::packetName(type)); \
+            } \
+        } \
+    } while (0)
+#else
+#define PAIRSIM_LOG_PACKET(type, msg) do {} while (0)
+#endif
+
+#endif // PAIRSIM_LOGGER_HPP_
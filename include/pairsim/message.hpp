@@ -0,0 +1,31 @@
+
+#ifndef PAIRSIM_MESSAGE_HPP_
+#define PAIRSIM_MESSAGE_HPP_
+
+// Internal classes
+#include "./buffer.hpp"
+#include "./device.hpp"
+#include "./packet_type.hpp"
+
+namespace ps {
+
+/**
+ * Outgoing packet, as kept in the node's queue until the next flush.
+ */
+struct Message {
+    /** Packet type. */
+    PacketType type;
+
+    /** Encoded packet. Empty when the device is handed over directly. */
+    Buffer buf;
+
+    /** Device handed over in memory to an in-process peer, if any. */
+    Device* device;
+
+    /** Tick the packet belongs to. */
+    std::uint64_t tick;
+};
+
+}
+
+#endif // PAIRSIM_MESSAGE_HPP_
@@ -0,0 +1,156 @@
+
+#ifndef PAIRSIM_METRICS_HPP_
+#define PAIRSIM_METRICS_HPP_
+
+// Standard lib utilities
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <string>
+
+// NNG HTTP server
+#include <nngpp/nngpp.h>
+#include <nngpp/http/http.h>
+
+namespace ps {
+
+/**
+ * Builds a page in the Prometheus text exposition format.
+ */
+class MetricsWriter {
+private:
+    std::string out;
+
+public:
+    /**
+     * Starts a metric family.
+     * \param name Metric name.
+     * \param help Description.
+     * \param type "counter", "gauge" or "histogram".
+     */
+    void family(const char* name, const char* help, const char* type) {
+        out += "# HELP ";
+        out += name;
+        out += ' ';
+        out += help;
+        out += "\n# TYPE ";
+        out += name;
+        out += ' ';
+        out += type;
+        out += '\n';
+    }
+
+    /**
+     * Writes a sample.
+     * \param name Metric name, with any suffix such as "_bucket".
+     * \param labels Labels without braces, e.g. `type="TICK"`, or empty.
+     * \param value Value.
+     */
+    void sample(const std::string& name, const std::string& labels, double value) {
+        out += name;
+        if (!labels.empty()) {
+            out += '{';
+            out += labels;
+            out += '}';
+        }
+        out += ' ';
+        out += number(value);
+        out += '\n';
+    }
+
+    /**
+     * Formats a value or a bucket bound.
+     * \param value Value.
+     * \returns Shortest exact text for integers, 9 significant digits
+     * otherwise.
+     */
+    static std::string number(double value) {
+        char text[32];
+        if (value >= 0 && value < 1e18 && value == (double) (std::uint64_t) value) {
+            std::snprintf(text, sizeof(text), "%llu", (unsigned long long) value);
+        }
+        else {
+            std::snprintf(text, sizeof(text), "%.9g", value);
+        }
+        return text;
+    }
+
+    /**
+     * Gets the page.
+     * \returns Page text.
+     */
+    const std::string& str() const {
+        return out;
+    }
+};
+
+/**
+ * Serves a page rendered on demand at "/metrics", from NNG's HTTP server
+ * threads. The page is rendered on those threads, so it must only read
+ * state that is safe to read while the node runs.
+ */
+class MetricsServer {
+private:
+    /** Renders the page. */
+    std::function<std::string()> render;
+
+    nng::http::server server;
+
+public:
+    /**
+     * Starts serving.
+     * \param address Address to listen on, e.g. "http://0.0.0.0:9100".
+     * \param _render Renders the page.
+     */
+    MetricsServer(const std::string& address, std::function<std::string()> _render) : render{_render} {
+        server = nng::http::make_server(nng::url(address.c_str()));
+
+        nng::http::handler handler = nng::http::make_handler("/metrics", handle);
+        handler.set_method("GET");
+        handler.set_data(this, nullptr);
+        server.add_handler(std::move(handler));
+
+        server.start();
+    }
+
+    MetricsServer(const MetricsServer& rhs) = delete;
+    MetricsServer& operator=(const MetricsServer& rhs) = delete;
+
+    /**
+     * Stops serving.
+     */
+    ~MetricsServer() {
+        server.stop();
+    }
+
+private:
+    /**
+     * Answers a request.
+     */
+    static void handle(nng_aio* a) {
+        const nng::aio_view aio{a};
+        const nng::http::handler_view handler{aio.get_input<nng_http_handler>(1)};
+        MetricsServer* self = (MetricsServer*) handler.get_data();
+
+        try {
+            const std::string page = self->render();
+
+            nng::http::res res = nng::http::make_res();
+            res.set_header("Content-Type", "text/plain; version=0.0.4");
+            res.copy_data(nng::view(page.data(), page.size()));
+
+            aio.set_output(0, res.release());
+            aio.finish();
+        }
+        catch (const nng::exception& e) {
+            aio.finish(e.get_error());
+        }
+        catch (...) {
+            aio.finish(nng::error::internal);
+        }
+    }
+};
+
+}
+
+#endif // PAIRSIM_METRICS_HPP_
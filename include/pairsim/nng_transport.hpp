@@ -0,0 +1,181 @@
+
+#ifndef PAIRSIM_NNG_TRANSPORT_HPP_
+#define PAIRSIM_NNG_TRANSPORT_HPP_
+
+// Standard lib utilities
+#include <cstring>
+
+// NNG
+#include <nngpp/protocol/pair0.h>
+#include <nngpp/nngpp.h>
+
+// Internal classes
+#include "transport.hpp"
+
+namespace ps {
+
+/**
+ * Transport backed by a NNG v0 Pair socket. Handles every address
+ * scheme NNG understands (tcp://, ipc://, inproc://, ...).
+ */
+class NngTransport : public Transport {
+private:
+    /** NNG socket. */
+    nng::socket sock;
+
+    /** Last received message, kept alive until the next recv(). */
+    nng::buffer last;
+
+    /** Asynchronous receive, allocated on first use. */
+    nng::aio aio;
+
+    /** Completion callback of the pending asynchronous receive. */
+    std::function<void()> onRecv;
+
+    /** Message completed by the asynchronous receive. */
+    nng::msg received;
+
+    /** Result of the asynchronous receive. */
+    nng::error receivedResult;
+
+    /** Whether an asynchronous receive completed and wasn't read yet. */
+    bool hasReceived;
+
+    /** Set while closing, so late aio callbacks are ignored. */
+    bool closing;
+
+public:
+    /**
+     * Creates a NNG transport, opening its socket.
+     */
+    NngTransport() : sock{nng::pair::v0::open()}, receivedResult{nng::error::success},
+                     hasReceived{false}, closing{false} {}
+
+    /**
+     * Destroys the transport, cancelling a pending asynchronous receive.
+     */
+    ~NngTransport() {
+        closing = true;
+        if (aio) {
+            aio.stop();
+        }
+    }
+
+    void listen(const std::string& address) {
+        sock.listen(address.c_str());
+    }
+
+    void dial(const std::string& address) {
+        sock.dial(address.c_str());
+    }
+
+    void send(const std::uint8_t* data, std::size_t size) {
+        sock.send(nng::view(data, size));
+    }
+
+    BufferView recv() {
+        if (hasReceived) {
+            hasReceived = false;
+            if (receivedResult != nng::error::success) {
+                throw nng::exception(receivedResult, "nng_recv_aio");
+            }
+            return BufferView{received.body().data<std::uint8_t>(), received.body().size()};
+        }
+
+        last = sock.recv();
+        return BufferView{(const std::uint8_t*) last.data(), last.size()};
+    }
+
+    void recvAsync(std::function<void()> done) {
+        if (!aio) {
+            aio = nng::make_aio(&NngTransport::recvDone, this);
+        }
+
+        onRecv = std::move(done);
+        sock.recv(aio);
+    }
+
+    /**
+     * Reads the socket's statistics, and those of its dialers and
+     * listeners. NNG snapshots every statistic in the process to do so,
+     * which takes tens of microseconds. Fails if NNG was built without
+     * statistics.
+     */
+    bool stats(TransportStats& stats) {
+        nng::stat all;
+        try {
+            all = nng::make_stat();
+        }
+        catch (const nng::exception& e) {
+            return false;
+        }
+
+        const nng::stat_view socketStats = all.find(nng::socket_view(sock));
+        if (!socketStats) {
+            return false;
+        }
+
+        stats.txMessages = valueOf(socketStats, "tx_msgs");
+        stats.rxMessages = valueOf(socketStats, "rx_msgs");
+        stats.txBytes = valueOf(socketStats, "tx_bytes");
+        stats.rxBytes = valueOf(socketStats, "rx_bytes");
+        stats.rejects = valueOf(socketStats, "reject");
+        stats.pipes = valueOf(socketStats, "pipes");
+        stats.disconnects = 0;
+
+        // dialers and listeners are nested scopes
+        for (nng::stat_view s = socketStats.child(); s; s = s.next()) {
+            if (s.type() == nng::stat_type::scope) {
+                stats.rejects += valueOf(s, "reject");
+                stats.disconnects += valueOf(s, "disconnect");
+            }
+        }
+
+        return true;
+    }
+
+    /**
+     * Gets the underlying NNG socket.
+     * \returns Socket view.
+     */
+    nng::socket_view socket() {
+        return sock;
+    }
+
+private:
+    /**
+     * Value of a statistic directly in a scope, 0 if missing.
+     */
+    static std::uint64_t valueOf(nng::stat_view scope, const char* name) {
+        for (nng::stat_view s = scope.child(); s; s = s.next()) {
+            if (s.type() != nng::stat_type::scope && std::strcmp(s.name(), name) == 0) {
+                return s.value();
+            }
+        }
+        return 0;
+    }
+
+    /**
+     * NNG aio callback, run on one of NNG's threads.
+     * \param arg Transport instance.
+     */
+    static void recvDone(void* arg) {
+        NngTransport* self = static_cast<NngTransport*>(arg);
+        if (self->closing) {
+            return;
+        }
+
+        self->receivedResult = self->aio.result();
+        if (self->receivedResult == nng::error::success) {
+            self->received = self->aio.release_msg();
+        }
+        self->hasReceived = true;
+
+        std::function<void()> done = std::move(self->onRecv);
+        done();
+    }
+};
+
+}
+
+#endif // PAIRSIM_NNG_TRANSPORT_HPP_
@@ -7,10 +7,11 @@
 #include <queue>
 #include <chrono>
 #include <thread>
-
-// NNG
-#include <nngpp/protocol/pair0.h>
-#include <nngpp/nngpp.h>
+#include <memory>
+#include <limits>
+#include <cmath>
+#include <algorithm>
+#include <iostream>
 
 // JSON handling
 #include <json.hpp>
@@ -21,13 +22,45 @@ using json = nlohmann::json;
 #include "buffer.hpp"
 #include "packet.hpp"
 #include "packet_type.hpp"
+#include "message.hpp"
+#include "subscription.hpp"
+#include "spatial_index.hpp"
+#include "transport.hpp"
+#include "transport_factory.hpp"
+#include "capture.hpp"
+#include "clock.hpp"
+#include "timing.hpp"
+#include "trace.hpp"
+#include "attribution.hpp"
+#include "counters.hpp"
+#include "metrics.hpp"
+#include "accounting.hpp"
+#include "logger.hpp"
+#include "footprint.hpp"
+#include "probes.hpp"
+#include "perf_counters.hpp"
+#ifdef __cpp_impl_coroutine
+#include "event_loop.hpp"
+#endif
 
-// Debugging log
-#ifdef PAIRSIM_DEBUG_ENABLED
-#include <iostream>
-#define PAIRSIM_DEBUG(str) std::cout << "[PS] " << str << std::endl
+// Times the rest of the enclosing scope as a phase of this node with
+// PAIRSIM_TIMING_ENABLED, expands to nothing otherwise
+#ifdef PAIRSIM_TIMING_ENABLED
+#define PAIRSIM_TIME_PHASE(phase) ps::PhaseTimer psPhaseTimer_{this->phaseTimes[ps::phase]}
 #else
-#define PAIRSIM_DEBUG(str)
+#define PAIRSIM_TIME_PHASE(phase)
+#endif
+
+// Hands the rest of the enclosing scope to the runtime phase hooks: traced
+// when a trace file is set, added to the wait attribution and counted by
+// hardware counters when those are on. Expands to nothing with
+// PAIRSIM_PHASE_HOOKS_DISABLED, which leaves those features off
+#ifndef PAIRSIM_PHASE_HOOKS_DISABLED
+#define PAIRSIM_PHASE_HOOKS(phase) \
+    ps::TraceSpan psTraceSpan_{this->traceLog, ps::phase, this->phaseTick(ps::phase), this->phaseElapsed(ps::phase)}; \
+    ps::PerfSpan psPerfSpan_{this->perfCounters.get(), ps::phase}
+#else
+#define PAIRSIM_PHASE_HOOKS(phase)
 #endif
 
 namespace ps {
@@ -41,6 +74,12 @@ protected:
     /** Tick duration. */
     DurationType tickDuration;
 
+    /** Number of ticks this node sent so far. */
+    std::uint64_t tickCount;
+
+    /** Number of ticks received from the peer so far. */
+    std::uint64_t peerTickCount;
+
     /** The address the client will dial / the server will listen. */
     std::string address;
 
@@ -48,7 +87,7 @@ protected:
     std::shared_ptr<ModelClass> model;
 
     /** The packet queue */
-    std::queue<Buffer> queue;
+    std::queue<Message> queue;
 
     /** A simple container to store devices for monitoring. */
     std::vector<DevicePtrType> devices;
@@ -59,15 +98,147 @@ protected:
     /** Container that relates a callback to an action name */
     std::map<std::string, std::function<void(json)>> actionCallbacks;
 
-    /** NNG socket. Currently a v0 Pair.*/
-    nng::socket sock;
+    /** Devices and fields this node wants from its peer. */
+    Subscription subscription;
+
+    /** Devices and fields the peer wants from this node. */
+    Subscription peerSubscription;
+
+    /** Scratch list of subscribed fields, reused across devices. */
+    std::vector<std::string> subscribedFields;
+
+    /** Index over this node's device positions, for spatial interest. */
+    SpatialIndex spatialIndex;
+
+    /** Detail of each device on this tick, see updateInterest(). */
+    std::vector<std::uint32_t> interest;
+
+    /** Dead reckoning error thresholds by device type. */
+    std::map<std::string, double> reckoningThresholds;
+
+    /** Where to record packets, empty for no capture. */
+    std::string capturePath;
+
+    /** Packet capture, open while running if capturePath is set. */
+    std::unique_ptr<CaptureLog> captureLog;
+
+    /** Trace of phases, packets and actions, if asked for. */
+    std::unique_ptr<TraceLog> traceLog;
+
+    /** Which side of the pair this node is, known on setup. */
+    capture::Role role;
+
+    /** Whether phase times are exchanged on TICKs, see setWaitAttribution. */
+    bool attributing;
+
+    /** Time per phase of the tick being produced, from its step to the
+     * end of the wait that follows its send, in ns. */
+    std::uint64_t phaseCycle[PHASE_COUNT];
+
+    /** Time per phase of the last whole cycle, in ns, see closeCycle(). */
+    std::uint64_t lastPhaseCycle[PHASE_COUNT];
+
+    /** Tick lastPhaseCycle is about. */
+    std::uint64_t lastCycleTick;
+
+    /** Whether lastPhaseCycle covers a whole cycle. */
+    bool lastCycleComplete;
+
+    /** Peer's time per phase for a tick, until this side's is known. */
+    std::uint64_t peerPhaseCycle[PHASE_COUNT];
+
+    /** Tick peerPhaseCycle is about. */
+    std::uint64_t peerCycleTick;
+
+    /** Whether peerPhaseCycle is still to be attributed. */
+    bool peerCyclePending;
+
+    /** Attribution of the latest tick both sides' times are known for. */
+    TickAttribution lastAttribution;
+
+    /** Attributions so far. */
+    AttributionSummary attributionSummary;
+
+    /** Link to the peer, chosen from the address on setup. */
+    std::unique_ptr<Transport> transport;
+
+#ifdef PAIRSIM_TIMING_ENABLED
+    /** Time spent in each phase, in ns. */
+    Histogram phaseTimes[PHASE_COUNT];
+#endif
+
+#ifdef __cpp_impl_coroutine
+    /** Event loop driving the awaitable API. */
+    EventLoop* loop;
+#endif
+
+    /** Counters readable while running, e.g. by the metrics endpoint. */
+    NodeCounters counters;
+
+    /** Time source of retry delays, overruns and statistics intervals. */
+    Clock* clock;
+
+    /** When the last TICK was queued, to count overruns. */
+    Clock::time_point lastTickTime;
+
+    /** Real-time factors asked for by this node and its peer, < 0 for
+     * none, and the one both follow, see setRealTimeFactor. */
+    double realTimeFactor;
+    double peerRealTimeFactor;
+    double agreedRealTimeFactor;
+
+    /** When pace() lets the next tick start, once pacing. */
+    Clock::time_point nextTickTime;
+    bool pacing;
+
+    /** Transport statistics last read by stats(). */
+    TransportStats transportStats;
+    bool hasTransportStats;
+    Clock::time_point transportStatsTime;
+
+    /** Minimum time between transport statistics reads. */
+    std::chrono::milliseconds transportStatsInterval;
+
+    /** Whether traffic is accounted by packet and device type, see
+     * setTrafficAccounting. */
+    bool accountingTraffic;
+
+    /** Entries per table of the report printed on end, 0 for none. */
+    std::size_t trafficReportTop;
+
+    /** Traffic by packet and device type, see setTrafficAccounting. */
+    TrafficAccounting traffic;
+
+    /** Size and decode time of the last packet received, for accounting
+     * it to its device type once it is handled. */
+    std::size_t lastReceivedSize;
+    std::uint64_t lastDecodeTime;
+
+    /** Hardware counters by phase, if on, see setPerfCounters. */
+    std::unique_ptr<PerfCounters> perfCounters;
+
+    /** Whether the counters are printed when the node ends. */
+    bool perfReport;
+
+    /** Metrics endpoint, if serving. Last so it stops before the rest
+     * of the node goes away. */
+    std::unique_ptr<MetricsServer> metricsServer;
 
 public:
     /**
      * Creates a node instance, only initializes members.
      */
-    Node() : running{false}, tickDuration{0}, address{""}, model{nullptr},
-             sock{nng::pair::v0::open()} {}
+    Node() : running{false}, tickDuration{0}, tickCount{0}, peerTickCount{0}, address{""}, model{nullptr},
+             role{capture::CLIENT}, attributing{false}, phaseCycle{}, lastPhaseCycle{}, lastCycleTick{0}, lastCycleComplete{false},
+             peerPhaseCycle{}, peerCycleTick{0}, peerCyclePending{false},
+             lastAttribution{}, attributionSummary{}, transport{nullptr}
+#ifdef __cpp_impl_coroutine
+             , loop{nullptr}
+#endif
+             , clock{&SteadyClock::instance()}, realTimeFactor{-1}, peerRealTimeFactor{-1},
+             agreedRealTimeFactor{1}, pacing{false}, transportStats{}, hasTransportStats{false}, transportStatsInterval{100}, accountingTraffic{false},
+             trafficReportTop{0}, lastReceivedSize{0}, lastDecodeTime{0}, perfReport{false}
+             {}
 
     /**
      * Destroys a node instance.
@@ -76,10 +247,14 @@ public:
 
     /**
      * Sets the server's address.
-     * \param _address Address, e.g. "tcp://localhost:4000".
+     * \param _address Address, e.g. "tcp://localhost:4000", or
+     * "shm://name" for a shared memory link between same-host peers,
+     * "local://name" for peers linked into the same process or
+     * "uring+tcp://host:port" for the io_uring TCP backend (built with
+     * PAIRSIM_URING_ENABLED).
      */
     void setServerAddr(std::string _address) {
-        PAIRSIM_DEBUG("Setting server address");
+        PAIRSIM_LOG_DEBUG("Setting server address");
         address = _address;
     }
 
@@ -89,7 +264,7 @@ public:
      * deleted when the last instance of the shared pointer is destroyed.
      */
     void setModel(std::shared_ptr<ModelClass> _model) {
-        PAIRSIM_DEBUG("Setting model");
+        PAIRSIM_LOG_DEBUG("Setting model");
         model = _model;
     }
 
@@ -100,7 +275,7 @@ public:
      * \param _tickDuration Tick duration.
      */
     void setTickDuration(DurationType _tickDuration) {
-        PAIRSIM_DEBUG("Setting tick duration");
+        PAIRSIM_LOG_DEBUG("Setting tick duration");
         tickDuration = _tickDuration;
     }
 
@@ -110,26 +285,540 @@ public:
      * \returns Previously set tick duration.
      */
     DurationType getTickDuration() {
-        // PAIRSIM_DEBUG("Getting tick duration");
+        // PAIRSIM_LOG_DEBUG("Getting tick duration");
         return tickDuration;
     }
 
+    /**
+     * Sets the clock this node's timing follows: retry delays, tick
+     * overruns and the transport statistics interval. A VirtualClock
+     * lets test scenarios run faster than real time, with models pacing
+     * ticks through getClock() instead of sleeping themselves. Set it
+     * before setup; an event loop driving the node needs the same clock
+     * (see EventLoop::setClock).
+     * \param _clock Clock, which must outlive the node.
+     */
+    void setClock(Clock* _clock) {
+        PAIRSIM_LOG_DEBUG("Setting clock");
+        clock = _clock;
+    }
+
+    /**
+     * Gets the clock this node's timing follows.
+     * \returns Clock, SteadyClock::instance() unless set.
+     */
+    Clock& getClock() {
+        return *clock;
+    }
+
+    /**
+     * Asks for a real-time factor, how many simulated seconds pass per
+     * wall second, and sends it to the peer (during setup if called
+     * before it). Both sides follow the slowest factor either asked for,
+     * so a peer that has to keep up with wall time, e.g. a simulator
+     * with a human in the loop, is never outrun; if only one side asks,
+     * the other goes along, and if neither does they run in real time.
+     * pace() and tick overruns follow the agreed factor, and both models
+     * hear about changes through onRealTimeFactor.
+     * \param factor 1 for real time, 2 for twice as fast and so on, 0 for
+     * as fast as possible, < 0 to withdraw the request.
+     */
+    void setRealTimeFactor(double factor) {
+        PAIRSIM_LOG_DEBUG("Setting real-time factor {}", factor);
+        realTimeFactor = factor < 0 ? -1 : factor;
+
+        if (running) {
+            enqueue(PacketType::REAL_TIME_FACTOR, packet::realTimeFactor(realTimeFactor));
+        }
+        agreeRealTimeFactor();
+    }
+
+    /**
+     * Gets the real-time factor both sides agreed on.
+     * \returns Simulated seconds per wall second, 0 for as fast as
+     * possible.
+     */
+    double getRealTimeFactor() {
+        return agreedRealTimeFactor;
+    }
+
+    /**
+     * Blocks until the next tick is due at the agreed real-time factor,
+     * on this node's clock, for loops that drive ticks themselves. Ticks
+     * are scheduled one tick duration, scaled by the factor, apart; a
+     * node that fell more than a tick behind starts over from now
+     * instead of catching up in a burst. Returns right away when running
+     * as fast as possible or when the tick duration isn't a
+     * std::chrono duration.
+     */
+    void pace() {
+        const std::chrono::nanoseconds period = tickPeriod();
+        const Clock::time_point now = clock->now();
+
+        if (period.count() <= 0 || !pacing || nextTickTime + period < now) {
+            nextTickTime = now;
+            pacing = true;
+            return;
+        }
+
+        nextTickTime += period;
+        clock->sleepUntil(nextTickTime);
+    }
+
+    /**
+     * Returns how many ticks this node sent so far. Devices use it to
+     * decide whether they are due (see Device::isDue).
+     * \returns Tick count.
+     */
+    std::uint64_t getTickCount() {
+        return tickCount;
+    }
+
+#ifdef PAIRSIM_TIMING_ENABLED
+    /**
+     * Gets the time spent in a phase so far. Safe to call from another
+     * thread while the node runs.
+     * \param phase Phase.
+     * \returns Histogram of the phase's durations, in ns.
+     */
+    const Histogram& getPhaseTimes(Phase phase) {
+        return phaseTimes[phase];
+    }
+
+    /**
+     * Clears the phase timings, e.g. after a warmup.
+     */
+    void resetPhaseTimes() {
+        for (int i = 0; i < PHASE_COUNT; i++) {
+            phaseTimes[i].reset();
+        }
+    }
+#endif
+
     /**
      * Whether the connection ended.
      * \returns `true` if the connection ended or `false` otherwise.
      */
     bool shouldEnd() {
-        PAIRSIM_DEBUG("Should end?");
+        PAIRSIM_LOG_DEBUG("Should end?");
         return !running;
     }
 
+#ifdef __cpp_impl_coroutine
+    /**
+     * Sets the event loop that resumes the awaitable API (setupAsync,
+     * tickAsync, waitTickAsync). A single loop can drive many nodes.
+     * \param _loop Event loop, which must outlive the node's coroutines.
+     */
+    void setEventLoop(EventLoop* _loop) {
+        PAIRSIM_LOG_DEBUG("Setting event loop");
+        loop = _loop;
+    }
+#endif
+
+    /**
+     * Sets which devices and fields this node wants from its peer, so
+     * that the peer only serializes and sends those. Set before setup (or
+     * from the model's setup) it is sent during the SETUP phase; later
+     * changes go out with the next flush.
+     * \param _subscription Subscription, empty for everything.
+     */
+    void subscribe(Subscription _subscription) {
+        PAIRSIM_LOG_DEBUG("Subscribing");
+        subscription = _subscription;
+
+        if (running) {
+            enqueue(PacketType::SUBSCRIBE, packet::subscribe(subscription));
+        }
+    }
+
+    /**
+     * Sets the cell size of the index over this node's device positions,
+     * used when the peer has spatial interest. Best close to the peer's
+     * observer radii.
+     * \param cellSize Cell edge length, in position units.
+     */
+    void setSpatialCellSize(double cellSize) {
+        spatialIndex.setCellSize(cellSize);
+    }
+
+    /**
+     * Enables dead reckoning for a device type. Its devices are then only
+     * sent when their position (Device::getPosition) drifts more than a
+     * threshold away from what the peer predicts from the last position
+     * and velocity (Device::getVelocity) it got. In between, the peer
+     * moves them along with Device::extrapolate().
+     * \param deviceType Device type.
+     * \param threshold Largest prediction error, in position units,
+     * <= 0 to disable.
+     */
+    void setDeadReckoning(std::string deviceType, double threshold) {
+        if (threshold > 0) {
+            reckoningThresholds[deviceType] = threshold;
+        }
+        else {
+            reckoningThresholds.erase(deviceType);
+        }
+    }
+
+    /**
+     * Records every packet sent and received, with its tick index and a
+     * timestamp, to a binary capture log (see CaptureLog). The log can
+     * be played back to a live peer with ReplayPeer. Must be called
+     * before setup.
+     * \param path Capture file, truncated on setup. Empty to disable.
+     */
+    void setCaptureFile(std::string path) {
+        PAIRSIM_LOG_DEBUG("Setting capture file");
+        capturePath = path;
+    }
+
+    /**
+     * Traces setup, tick phases, packets sent and received and action
+     * callbacks to a Chrome Trace Event JSON file, each event tagged with
+     * its tick index. Phases are left out with PAIRSIM_PHASE_HOOKS_DISABLED. Traces of both peers can be merged into a single
+     * timeline with tools/tracemerge. Must be called before setup; the
+     * trace is completed when the node ends.
+     * \param path Trace file, truncated right away. Empty to disable.
+     */
+    void setTraceFile(std::string path) {
+        PAIRSIM_LOG_DEBUG("Setting trace file");
+        traceLog.reset(path.empty() ? nullptr : new TraceLog(path));
+    }
+
+    /**
+     * Exchanges each side's step, serialization, send and wait times on
+     * TICKs, so that every tick can be attributed to the client's work,
+     * the server's work or the network (see TickAttribution). Both sides
+     * must enable it. Unavailable with PAIRSIM_PHASE_HOOKS_DISABLED.
+     * \param enabled Whether to measure and exchange phase times.
+     */
+    void setWaitAttribution(bool enabled) {
+#ifdef PAIRSIM_PHASE_HOOKS_DISABLED
+        if (enabled) {
+            PAIRSIM_LOG_WARN("Wait attribution needs phase hooks, built with PAIRSIM_PHASE_HOOKS_DISABLED");
+            enabled = false;
+        }
+#endif
+        attributing = enabled;
+        std::fill(phaseCycle, phaseCycle + PHASE_COUNT, 0);
+        lastCycleComplete = false;
+        peerCyclePending = false;
+    }
+
+    /**
+     * Gets the attribution of the latest tick both sides' phase times
+     * are known for, usually the one before last.
+     * \returns Tick attribution, zeroed if there is none yet.
+     */
+    const TickAttribution& getLastAttribution() {
+        return lastAttribution;
+    }
+
+    /**
+     * Gets the tick attributions aggregated so far.
+     * \returns Summary.
+     */
+    const AttributionSummary& getAttributionSummary() {
+        return attributionSummary;
+    }
+
+    /**
+     * Clears the aggregated tick attributions, e.g. after a warmup.
+     */
+    void resetAttributionSummary() {
+        attributionSummary = AttributionSummary{};
+    }
+
+    /**
+     * Serves metrics in the Prometheus text format at "/metrics": tick
+     * counts, packets and bytes per packet type, queue depth, device
+     * count, tick overruns (ticks longer than the tick duration) and,
+     * with PAIRSIM_TIMING_ENABLED, phase time histograms. Requests are
+     * answered from NNG's HTTP threads, reading counters the node keeps
+     * without locks.
+     * \param address Address to listen on, e.g. "http://0.0.0.0:9100".
+     * Empty to stop serving.
+     */
+    void serveMetrics(std::string address) {
+        PAIRSIM_LOG_DEBUG("Serving metrics");
+        metricsServer.reset();
+        if (!address.empty()) {
+            metricsServer.reset(new MetricsServer(address, [this]() { return renderMetrics(); }));
+        }
+    }
+
+    /**
+     * Renders the metrics page (see serveMetrics). Safe to call from any
+     * thread while the node runs.
+     * \returns Page in the Prometheus text format.
+     */
+    std::string renderMetrics() {
+        MetricsWriter w;
+
+        w.family("pairsim_ticks_total", "TICKs sent.", "counter");
+        w.sample("pairsim_ticks_total", "", counters.ticks.get());
+        w.family("pairsim_peer_ticks_total", "TICKs received from the peer.", "counter");
+        w.sample("pairsim_peer_ticks_total", "", counters.peerTicks.get());
+        w.family("pairsim_tick_overruns_total", "Ticks longer than the tick duration at the real-time factor.",
+                 "counter");
+        w.sample("pairsim_tick_overruns_total", "", counters.overruns.get());
+        w.family("pairsim_queue_depth", "Packets sent by the last flush.", "gauge");
+        w.sample("pairsim_queue_depth", "", counters.queueDepth.get());
+        w.family("pairsim_devices", "Devices this node sends.", "gauge");
+        w.sample("pairsim_devices", "", counters.devices.get());
+
+        const struct {
+            const char* name;
+            const char* help;
+            PacketCounters (&counts)[256];
+            bool bytes;
+        } families[] = {
+            {"pairsim_packets_sent_total", "Packets sent, by type.", counters.sent, false},
+            {"pairsim_bytes_sent_total", "Encoded bytes sent, by packet type.", counters.sent, true},
+            {"pairsim_packets_received_total", "Packets received, by type.", counters.received, false},
+            {"pairsim_bytes_received_total", "Encoded bytes received, by packet type.", counters.received, true},
+        };
+
+        for (const auto& f : families) {
+            w.family(f.name, f.help, "counter");
+            for (PacketType type : PACKET_TYPES) {
+                const PacketCounters& c = f.counts[type];
+                w.sample(f.name, std::string("type=\"") + packetName(type) + "\"",
+                         f.bytes ? c.bytes.get() : c.packets.get());
+            }
+        }
+
+#ifdef PAIRSIM_TIMING_ENABLED
+        static const double bounds[] = {1e-6, 1e-5, 1e-4, 5e-4, 1e-3, 5e-3, 1e-2, 5e-2, 0.1, 0.5, 1, 5};
+
+        w.family("pairsim_phase_seconds", "Time spent in each phase.", "histogram");
+        for (int p = 0; p < PHASE_COUNT; p++) {
+            const Histogram& h = phaseTimes[p];
+            const std::string phase = std::string("phase=\"") + phaseName(Phase(p)) + "\"";
+
+            for (double bound : bounds) {
+                w.sample("pairsim_phase_seconds_bucket", phase + ",le=\"" + MetricsWriter::number(bound) + "\"",
+                         h.countAtMost((std::uint64_t) (bound * 1e9)));
+            }
+            w.sample("pairsim_phase_seconds_bucket", phase + ",le=\"+Inf\"", h.count());
+            w.sample("pairsim_phase_seconds_sum", phase, h.sum() / 1e9);
+            w.sample("pairsim_phase_seconds_count", phase, h.count());
+        }
+#endif
+
+        return w.str();
+    }
+
+    /**
+     * Takes a snapshot of this node's counters and its transport's
+     * statistics (e.g. NNG's socket, dialer and listener statistics), to
+     * correlate transport stalls with tick overruns. The counters are
+     * read fresh; transport statistics, costlier to gather, are refreshed
+     * at most once per setTransportStatsInterval. Cheap enough to call on
+     * every tick, from the node's thread.
+     * \returns Snapshot.
+     */
+    NodeStats stats() {
+        NodeStats s{};
+        s.ticks = counters.ticks.get();
+        s.peerTicks = counters.peerTicks.get();
+        s.overruns = counters.overruns.get();
+        s.queueDepth = counters.queueDepth.get();
+        s.devices = counters.devices.get();
+
+        for (PacketType type : PACKET_TYPES) {
+            s.packetsSent += counters.sent[type].packets.get();
+            s.bytesSent += counters.sent[type].bytes.get();
+            s.packetsReceived += counters.received[type].packets.get();
+            s.bytesReceived += counters.received[type].bytes.get();
+        }
+
+        const auto now = clock->now();
+        if (transport != nullptr && (!hasTransportStats || now - transportStatsTime >= transportStatsInterval)) {
+            hasTransportStats = transport->stats(transportStats);
+            transportStatsTime = now;
+        }
+
+        s.hasTransport = hasTransportStats;
+        s.transport = transportStats;
+        s.transportTime = transportStatsTime;
+        return s;
+    }
+
+    /**
+     * Sets how often stats() refreshes transport statistics.
+     * \param interval Minimum time between refreshes, 0 for every call.
+     */
+    void setTransportStatsInterval(std::chrono::milliseconds interval) {
+        transportStatsInterval = interval;
+    }
+
+    /**
+     * Counts messages, encoded bytes and encode and decode time by packet
+     * type and by device type, to find which devices dominate the traffic
+     * and whose serialize() to optimize first. Encode time is that of
+     * serializing and encoding devices, including those left unsent by a
+     * change threshold; decode time is that of decoding any packet plus
+     * deserializing devices. Costs two clock reads and a device type
+     * lookup per device when enabled.
+     * \param enabled Whether to account traffic.
+     * \param reportTop Number of packet types and device types, by bytes,
+     * printed to stdout when the node ends. 0 for no report.
+     */
+    void setTrafficAccounting(bool enabled, std::size_t reportTop=0) {
+        accountingTraffic = enabled;
+        trafficReportTop = reportTop;
+    }
+
+    /**
+     * Gets the traffic accounted so far, for top-N reports. Only read it
+     * from the node's thread.
+     * \returns Traffic by packet type and device type.
+     */
+    const TrafficAccounting& getTrafficAccounting() {
+        return traffic;
+    }
+
+    /**
+     * Clears the accounted traffic, e.g. after a warmup.
+     */
+    void resetTrafficAccounting() {
+        traffic.reset();
+    }
+
+    /**
+     * Counts cycles, instructions, cache misses and branch misses per
+     * phase with the CPU's performance counters (see PerfCounters), e.g.
+     * to tell whether device handling in the wait phase is bound by cache
+     * misses. Costs two read system calls per phase when on. Counters are
+     * per thread, so call it from the thread running the node.
+     * \param enabled Whether to count.
+     * \param report Whether to print the counts to stdout when the node
+     * ends.
+     * \returns `true` if counting, `false` if disabled or if no counter
+     * is available, e.g. off Linux or with PAIRSIM_PHASE_HOOKS_DISABLED, in which case a warning is logged and
+     * the node runs on without them.
+     */
+    bool setPerfCounters(bool enabled, bool report=false) {
+        perfCounters.reset();
+        perfReport = report;
+        if (!enabled) {
+            return false;
+        }
+
+#ifdef PAIRSIM_PHASE_HOOKS_DISABLED
+        PAIRSIM_LOG_WARN("Hardware counters need phase hooks, built with PAIRSIM_PHASE_HOOKS_DISABLED");
+        return false;
+#else
+        try {
+            perfCounters.reset(new PerfCounters());
+        }
+        catch (const std::runtime_error& e) {
+            PAIRSIM_LOG_WARN("{}", e.what());
+            return false;
+        }
+        return true;
+#endif
+    }
+
+    /**
+     * Gets the hardware counts by phase so far. Only read them from the
+     * node's thread.
+     * \returns Counters, null if not counting.
+     */
+    const PerfCounters* getPerfCounters() {
+        return perfCounters.get();
+    }
+
+    /**
+     * Clears the hardware counts, e.g. after a warmup.
+     */
+    void resetPerfCounters() {
+        if (perfCounters != nullptr) {
+            perfCounters->reset();
+        }
+    }
+
+    /**
+     * Estimates the memory this node holds, by component and by device
+     * type, to size hosts running many pairs. Walks every device, so call
+     * it from the node's thread and not on every tick.
+     * \returns Footprint, in bytes.
+     */
+    MemoryFootprint memoryFootprint() {
+        MemoryFootprint f{};
+        f.node = sizeof(*this);
+
+        f.registry = memory::heap(devices);
+        for (const auto& t : devicesByType) {
+            const std::size_t entry = memory::mapNode<std::string, std::map<std::uint32_t, DevicePtrType>>()
+                                    + memory::heap(t.first);
+            f.registry += entry + t.second.size() * memory::mapNode<std::uint32_t, DevicePtrType>();
+            f.deviceTypes[t.first].bytes += entry;
+        }
+
+        for (const DevicePtrType& d : devices) {
+            const std::size_t device = d->memoryUsage();
+            const std::size_t control = memory::controlBlock(d);
+            f.devices += device;
+            f.controlBlocks += control;
+
+            DeviceTypeFootprint& t = f.deviceTypes[d->getDeviceType()];
+            t.devices++;
+            t.bytes += device + control + sizeof(DevicePtrType) + memory::mapNode<std::uint32_t, DevicePtrType>();
+        }
+
+        // deque of 512 byte chunks
+        const std::size_t perChunk = std::max<std::size_t>(1, 512 / sizeof(Message));
+        f.queue = (queue.size() / perChunk + 1) * 512 + 8 * sizeof(void*);
+        for (const Message& m : QueueAccess::of(queue)) {
+            f.queue += memory::heap(m.buf);
+        }
+
+        for (const auto& a : actionCallbacks) {
+            f.actions += memory::mapNode<std::string, std::function<void(json)>>() + memory::heap(a.first);
+        }
+
+        f.caches = subscription.memoryUsage() + peerSubscription.memoryUsage() + memory::heap(subscribedFields)
+                 + spatialIndex.memoryUsage() + memory::heap(interest) + traffic.memoryUsage()
+                 + reckoningThresholds.size() * memory::mapNode<std::string, double>();
+        for (const auto& r : reckoningThresholds) {
+            f.caches += memory::heap(r.first);
+        }
+        if (traceLog != nullptr) {
+            f.caches += sizeof(TraceLog) + (1 << 20);
+        }
+        if (perfCounters != nullptr) {
+            f.caches += sizeof(PerfCounters);
+        }
+
+        return f;
+    }
+
+    /**
+     * Gets the counters this node keeps, readable from any thread.
+     * \returns Counters.
+     */
+    const NodeCounters& getCounters() {
+        return counters;
+    }
+
+    /**
+     * Gets the subscription this node sent to its peer.
+     * \returns Subscription, empty for everything.
+     */
+    const Subscription& getSubscription() {
+        return subscription;
+    }
+
     /**
      * Relates an action name to a callback.
      * \param actionName Action name.
      * \param cb Action callback.
      */
     void addAction(std::string actionName, std::function<void(json)> cb) {
-        PAIRSIM_DEBUG("Adding action " << actionName);
+        PAIRSIM_LOG_DEBUG("Adding action {}", actionName);
         actionCallbacks[actionName] = cb;
     }
 
@@ -139,8 +828,8 @@ public:
      * \param params JSON defined parameters.
      */
     void sendAction(std::string actionName, json params) {
-        PAIRSIM_DEBUG("Sending action " << actionName);
-        queue.push(packet::action(actionName, params));
+        PAIRSIM_LOG_DEBUG("Sending action {}", actionName);
+        enqueue(PacketType::ACTION, packet::action(actionName, params));
     }
 
     /**
@@ -159,15 +848,27 @@ public:
      */
     void end(bool shouldEndPair=true) {
         if (running) {
-            PAIRSIM_DEBUG("Finishing execution.");
+            PAIRSIM_LOG_DEBUG("Finishing execution.");
             model->end();
 
             if (shouldEndPair) {
-                queue.push(packet::end());
+                enqueue(PacketType::END, packet::end());
                 flush();
             }
 
+            captureLog.reset();
+            traceLog.reset();
             running = false;
+
+            if (accountingTraffic && trafficReportTop > 0) {
+                std::cout << "Traffic of the " << (role == capture::CLIENT ? "client" : "server") << ":" << std::endl;
+                traffic.report(std::cout, trafficReportTop);
+            }
+            if (perfCounters != nullptr && perfReport) {
+                std::cout << "Hardware counters of the " << (role == capture::CLIENT ? "client" : "server") << ":"
+                          << std::endl;
+                perfCounters->report(std::cout);
+            }
         }
     }
 
@@ -189,15 +890,406 @@ public:
     virtual void waitTick() = 0;
 
 protected:
+    /**
+     * Reads the packet queue's underlying container.
+     */
+    struct QueueAccess : std::queue<Message> {
+        static const std::deque<Message>& of(const std::queue<Message>& q) {
+            return q.*&QueueAccess::c;
+        }
+    };
+
+    /**
+     * Queues an encoded packet.
+     * \param type Packet type.
+     * \param buf Encoded packet.
+     */
+    void enqueue(PacketType type, Buffer&& buf) {
+        queue.push(Message{type, std::move(buf), nullptr, tickCount});
+    }
+
+    /**
+     * Closes the cycle of the previous tick when the next one starts,
+     * its wait being over, and attributes it if the peer's times for the
+     * same tick already arrived. Called by getData() before the step.
+     */
+    void closeCycle() {
+        if (!attributing) {
+            return;
+        }
+
+        std::copy(phaseCycle, phaseCycle + PHASE_COUNT, lastPhaseCycle);
+        std::fill(phaseCycle, phaseCycle + PHASE_COUNT, 0);
+        lastCycleComplete = tickCount > 0;
+        lastCycleTick = tickCount - 1;
+        attributeCycle();
+    }
+
+    /**
+     * Attributes a tick once both sides' phase times for it are known.
+     */
+    void attributeCycle() {
+        if (!lastCycleComplete || !peerCyclePending || peerCycleTick != lastCycleTick) {
+            return;
+        }
+
+        lastAttribution = role == capture::CLIENT
+            ? TickAttribution::from(lastCycleTick, lastPhaseCycle, peerPhaseCycle)
+            : TickAttribution::from(lastCycleTick, peerPhaseCycle, lastPhaseCycle);
+        attributionSummary.add(lastAttribution);
+        peerCyclePending = false;
+    }
+
+    /**
+     * Queues this tick's TICK, with the phase times of the last whole
+     * cycle when attributing waits.
+     */
+    void queueTick() {
+        if (attributing && lastCycleComplete) {
+            enqueue(PacketType::TICK, packet::tick(lastPhaseCycle, lastCycleTick));
+        }
+        else {
+            enqueue(PacketType::TICK, packet::tick());
+        }
+        tickCount++;
+        counters.ticks.add();
+
+        const std::chrono::nanoseconds period = tickPeriod();
+        if (period.count() > 0) {
+            const auto now = clock->now();
+            if (tickCount > 1 && now - lastTickTime > period) {
+                counters.overruns.add();
+            }
+            lastTickTime = now;
+        }
+    }
+
+    /**
+     * Converts a tick duration, if it's a std::chrono duration.
+     */
+    template <typename Rep, typename Period>
+    static std::chrono::nanoseconds toNanoseconds(std::chrono::duration<Rep, Period> d) {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(d);
+    }
+
+    /**
+     * Tick durations of other types have no known unit, so overruns are
+     * not counted for them.
+     */
+    template <typename T>
+    static std::chrono::nanoseconds toNanoseconds(T d) {
+        return std::chrono::nanoseconds(0);
+    }
+
+    /**
+     * Gets the wall time a tick should take at the agreed real-time
+     * factor.
+     * \returns Period, 0 when running as fast as possible or without a
+     * known tick duration.
+     */
+    std::chrono::nanoseconds tickPeriod() {
+        if (agreedRealTimeFactor <= 0) {
+            return std::chrono::nanoseconds(0);
+        }
+        return std::chrono::nanoseconds((std::int64_t) (toNanoseconds(tickDuration).count() / agreedRealTimeFactor));
+    }
+
+    /**
+     * Settles on the slowest real-time factor asked for, telling the
+     * model if it changed.
+     */
+    void agreeRealTimeFactor() {
+        double factor = 1;
+        if (realTimeFactor >= 0 && peerRealTimeFactor >= 0) {
+            // 0, as fast as possible, gives way to any limit
+            factor = realTimeFactor == 0 ? peerRealTimeFactor
+                   : peerRealTimeFactor == 0 ? realTimeFactor
+                   : std::min(realTimeFactor, peerRealTimeFactor);
+        }
+        else if (realTimeFactor >= 0 || peerRealTimeFactor >= 0) {
+            factor = std::max(realTimeFactor, peerRealTimeFactor);
+        }
+
+        if (factor != agreedRealTimeFactor) {
+            PAIRSIM_LOG_INFO("Real-time factor is now {}", factor);
+            agreedRealTimeFactor = factor;
+            pacing = false;
+            if (model != nullptr) {
+                model->onRealTimeFactor(factor);
+            }
+        }
+    }
+
+    /**
+     * Queues the subscription and real-time factor set before setup, if
+     * any.
+     */
+    void queueSettings() {
+        if (!subscription.empty()) {
+            enqueue(PacketType::SUBSCRIBE, packet::subscribe(subscription));
+        }
+        if (realTimeFactor >= 0) {
+            enqueue(PacketType::REAL_TIME_FACTOR, packet::realTimeFactor(realTimeFactor));
+        }
+    }
+
+    /**
+     * Queues this tick's DEVICE packets, culling and thinning out devices
+     * by the peer's spatial interest, if any.
+     */
+    void queueDeviceUpdates() {
+        counters.devices.set(devices.size());
+
+        const bool spatial = peerSubscription.spatial();
+        if (spatial) {
+            updateInterest();
+        }
+
+        for (size_t i = 0; i < devices.size(); i++) {
+            const LevelOfDetail* level = nullptr;
+
+            if (spatial) {
+                if (interest[i] == std::numeric_limits<std::uint32_t>::max()) {
+                    continue;
+                }
+                if (interest[i] > 0) {
+                    level = &peerSubscription.getLevelsOfDetail()[interest[i] - 1];
+                }
+            }
+
+            queueDeviceUpdate(devices[i], level);
+        }
+    }
+
+    /**
+     * Moves devices in the spatial index and ranks them against the peer's
+     * regions and observers: 0 is full detail, k + 1 is level of detail k
+     * and the maximum value means culled. Devices without a position
+     * always get full detail.
+     */
+    void updateInterest() {
+        const std::uint32_t culled = std::numeric_limits<std::uint32_t>::max();
+        interest.assign(devices.size(), 0);
+
+        for (size_t i = 0; i < devices.size(); i++) {
+            Position pos;
+            if (devices[i]->getPosition(pos)) {
+                spatialIndex.update(i, pos);
+                interest[i] = culled;
+            }
+            else {
+                spatialIndex.remove(i);
+            }
+        }
+
+        for (const auto& region : peerSubscription.getRegions()) {
+            spatialIndex.query(region.min, region.max, [&](std::size_t i, const Position& pos) {
+                interest[i] = 0;
+            });
+        }
+
+        for (const auto& observer : peerSubscription.getObservers()) {
+            const Position& o = observer.pos;
+            const double r = observer.radius;
+
+            spatialIndex.query(Position{o.x - r, o.y - r, o.z - r}, Position{o.x + r, o.y + r, o.z + r},
+                               [&](std::size_t i, const Position& pos) {
+                const double dx = pos.x - o.x, dy = pos.y - o.y, dz = pos.z - o.z;
+                const double distance = std::sqrt(dx * dx + dy * dy + dz * dz);
+                if (distance <= r) {
+                    const std::uint32_t rank = peerSubscription.levelFor(distance) + 1;
+                    interest[i] = std::min(interest[i], rank);
+                }
+            });
+        }
+    }
+
+    /**
+     * Queues a DEVICE packet if the peer subscribed to the device, it is
+     * due on the current tick and, when it has a change threshold, it
+     * changed enough. Otherwise the peer keeps its last known state.
+     * Only the subscribed fields are serialized, at the precision of the
+     * level of detail, except for in-process pairs, which hand over the
+     * whole device.
+     * \param d Device whose data may be sent.
+     * \param level Level of detail, nullptr for full detail.
+     */
+    void queueDeviceUpdate(const DevicePtrType& d, const LevelOfDetail* level=nullptr) {
+        if (d->wasSent() && !d->isDue(tickCount)) {
+            return;
+        }
+        if (level != nullptr && level->period > 1 && d->wasSent() && (tickCount + d->getId()) % level->period != 0) {
+            return;
+        }
+
+        bool partial = false;
+        if (!peerSubscription.empty()) {
+            const std::string deviceType = d->getDeviceType();
+            if (!peerSubscription.matches(deviceType, d->getId())) {
+                return;
+            }
+            partial = !transport->direct() && peerSubscription.fieldsFor(deviceType, d->getId(), subscribedFields);
+        }
+
+        Reckoning reckoning{};
+        if (!reckoningThresholds.empty() && !reckon(d, reckoning)) {
+            return;
+        }
+
+        const double precision = level != nullptr && !transport->direct() ? level->precision : 0;
+
+        if (d->getChangeThreshold() > 0 || partial || precision > 0 || reckoning.valid) {
+            const std::uint64_t start = accountingTraffic ? TraceLog::now() : 0;
+            json data = partial ? d->serializeFields(subscribedFields) : d->serialize();
+            Subscription::quantize(data, precision);
+            if (d->getChangeThreshold() > 0 && !d->changedEnough(data)) {
+                if (accountingTraffic) {
+                    accountEncoded(d, start, false);
+                }
+                return;
+            }
+            if (reckoning.valid) {
+                d->setSentReckoning(reckoning);
+            }
+            if (!transport->direct()) {
+                d->markSent();
+                if (reckoning.valid) {
+                    enqueue(PacketType::DEVICE, packet::device<DevicePtrType>(d, std::move(data), reckoning));
+                }
+                else {
+                    enqueue(PacketType::DEVICE, packet::device<DevicePtrType>(d, std::move(data)));
+                }
+                if (accountingTraffic) {
+                    accountEncoded(d, start, true);
+                }
+                return;
+            }
+        }
+
+        d->markSent();
+        queueDevice(d);
+    }
+
+    /**
+     * Runs the peer's dead reckoning predictor for a device.
+     * \param d Device whose data may be sent.
+     * \param reckoning Output, the current state when it should be sent
+     * along with the device. Left invalid if the device isn't dead reckoned.
+     * \returns `false` if the prediction is good enough to skip the device.
+     */
+    bool reckon(const DevicePtrType& d, Reckoning& reckoning) {
+        const auto threshold = reckoningThresholds.find(d->getDeviceType());
+        if (threshold == reckoningThresholds.end()) {
+            return true;
+        }
+        if (!d->getPosition(reckoning.pos) || !d->getVelocity(reckoning.vel)) {
+            return true;
+        }
+
+        const Reckoning& sent = d->getSentReckoning();
+        if (d->wasSent() && sent.valid) {
+            const Position predicted = sent.predict(tickCount);
+            const double dx = reckoning.pos.x - predicted.x;
+            const double dy = reckoning.pos.y - predicted.y;
+            const double dz = reckoning.pos.z - predicted.z;
+
+            if (dx * dx + dy * dy + dz * dz <= threshold->second * threshold->second) {
+                return false;
+            }
+        }
+
+        reckoning.valid = true;
+        reckoning.tick = tickCount;
+        return true;
+    }
+
+    /**
+     * Queues a DEVICE packet. In-process pairs get the device itself
+     * instead of its serialized state.
+     * \param d Device whose data is to be sent.
+     */
+    void queueDevice(const DevicePtrType& d) {
+        const std::uint64_t start = accountingTraffic ? TraceLog::now() : 0;
+        if (transport->direct()) {
+            queue.push(Message{PacketType::DEVICE, Buffer(), &*d, tickCount});
+        }
+        else {
+            enqueue(PacketType::DEVICE, packet::device<DevicePtrType>(d));
+        }
+        if (accountingTraffic) {
+            accountEncoded(d, start, true);
+        }
+    }
+
+    /**
+     * Accounts a device serialized since a timestamp to its device type
+     * and to DEVICE packets.
+     * \param d Device.
+     * \param start When serialization started, see TraceLog::now().
+     * \param queued Whether the last queued message is its DEVICE packet.
+     */
+    void accountEncoded(const DevicePtrType& d, std::uint64_t start, bool queued) {
+        const std::uint64_t elapsed = TraceLog::now() - start;
+        traffic.packet(PacketType::DEVICE).encodeTime += elapsed;
+
+        TrafficCounts& c = traffic.device(d->getDeviceType());
+        c.encodeTime += elapsed;
+        if (queued) {
+            c.sent++;
+            c.sentBytes += queue.back().buf.size();
+        }
+    }
+
+    /**
+     * Accounts a device deserialized since a timestamp to its device type
+     * and to DEVICE packets.
+     * \param deviceType Device type.
+     * \param start When deserialization started, see TraceLog::now().
+     * \param size Encoded size of its packet, 0 if handed over in memory.
+     * \param decodeTime Time its packet took to decode, in ns.
+     */
+    void accountDecoded(const std::string& deviceType, std::uint64_t start, std::size_t size,
+                        std::uint64_t decodeTime) {
+        const std::uint64_t elapsed = TraceLog::now() - start;
+        traffic.packet(PacketType::DEVICE).decodeTime += elapsed;
+
+        TrafficCounts& c = traffic.device(deviceType);
+        c.received++;
+        c.receivedBytes += size;
+        c.decodeTime += decodeTime + elapsed;
+    }
+
     /**
      * Flushes the packet queue, sending all queued data.
      */
     void flush() {
-        PAIRSIM_DEBUG("Flushing queue.");
+        PAIRSIM_LOG_DEBUG("Flushing queue.");
+        counters.queueDepth.set(queue.size());
+
         for (; queue.size(); queue.pop()) {
-            const Buffer buf = queue.front();
-            sock.send(nng::view(buf.data(), buf.size()));
+            const Message& m = queue.front();
+            counters.sent[m.type].packets.add();
+            counters.sent[m.type].bytes.add(m.buf.size());
+            if (accountingTraffic) {
+                TrafficCounts& c = traffic.packet(m.type);
+                c.sent++;
+                c.sentBytes += m.buf.size();
+            }
+            if (captureLog != nullptr) {
+                record(capture::SENT, m);
+            }
+            if (traceLog != nullptr) {
+                traceLog->packet(capture::SENT, m.type, m.tick, m.buf.size());
+            }
+            PAIRSIM_PROBE4(packet__send, (char) role, (int) m.type, m.buf.size(), m.tick);
+            if (m.device != nullptr) {
+                transport->sendDevice(m.device);
+            }
+            else {
+                transport->send(m.buf.data(), m.buf.size());
+            }
         }
+        transport->flush();
     }
 
     /**
@@ -207,47 +1299,16 @@ protected:
      * \param p Packet type to be waited.
      */
     void waitFor(PacketType p) {
-        PAIRSIM_DEBUG("Waiting for: " << p);
+        PAIRSIM_LOG_DEBUG("Waiting for {}", packetName(p));
         bool shouldBreak = false;
 
         while (!shouldBreak && running) {
-            PAIRSIM_DEBUG("Waiting...");
-            const nng::buffer buf = sock.recv();
-            const json msg = packet::decode((std::uint8_t*) buf.data(), buf.size());
-            const PacketType packetType = PacketType(msg["_t"].get<std::uint8_t>());
-
-            switch (packetType) {
-                case PacketType::ACTION:
-                    PAIRSIM_DEBUG("Received ACTION:" << msg.dump());
-                    handleAction(msg);
-                    break;
-                case PacketType::DEVICE:
-                    PAIRSIM_DEBUG("Received DEVICE:" << msg.dump());
-                    handleDevice(msg);
-                    break;
-                case PacketType::DEVICE_ADD:
-                    PAIRSIM_DEBUG("Received DEVICE_ADD:" << msg.dump());
-                    handleDeviceAdd(msg);
-                    break;
-                case PacketType::END:
-                    PAIRSIM_DEBUG("Received END:" << msg.dump());
-                    handleEnd(msg);
-                    break;
-                case PacketType::READY:
-                    PAIRSIM_DEBUG("Received READY:" << msg.dump());
-                    handleReady(msg);
-                    break;
-                case PacketType::NOT_READY:
-                    PAIRSIM_DEBUG("Received NOT_READY:" << msg.dump());
-                    handleNotReady(msg);
-                case PacketType::TICK:
-                    PAIRSIM_DEBUG("Received TICK:" << msg.dump());
-                    handleTick(msg);
-                    break;
-                case PacketType::SETUP:
-                    PAIRSIM_DEBUG("Received SETUP:" << msg.dump());
-                    handleSetup(msg);
-                    break;
+            PAIRSIM_LOG_TRACE("Waiting...");
+            json msg;
+            const PacketType packetType = receive(msg);
+
+            if (!msg.is_null()) {
+                dispatch(packetType, msg);
             }
 
             if (packetType == p) {
@@ -256,6 +1317,201 @@ protected:
         }
     }
 
+#ifdef __cpp_impl_coroutine
+    /**
+     * Awaitable version of waitFor(). Suspends on the event loop instead
+     * of blocking while waiting for packets, including the retry delay
+     * after a NOT_READY.
+     * \param p Packet type to be waited.
+     */
+    Task waitForAsync(PacketType p) {
+        PAIRSIM_LOG_DEBUG("Waiting for {}", packetName(p));
+        bool shouldBreak = false;
+
+        while (!shouldBreak && running) {
+            co_await loop->readable(*transport);
+
+            json msg;
+            const PacketType packetType = receive(msg);
+
+            if (packetType == PacketType::NOT_READY) {
+                PAIRSIM_LOG_PACKET(PacketType::NOT_READY, msg);
+                co_await loop->sleep(getRetryDelay());
+                enqueue(PacketType::READY, packet::ready());
+                flush();
+            }
+            else if (!msg.is_null()) {
+                dispatch(packetType, msg);
+            }
+
+            if (packetType == p) {
+                shouldBreak = true;
+            }
+        }
+    }
+#endif
+
+    /**
+     * Receives a single packet. Devices handed over in memory by an
+     * in-process peer are handled right away.
+     * \param msg Decoded message, left null for direct devices.
+     * \returns Received packet type.
+     */
+    PacketType receive(json& msg) {
+        const BufferView buf = transport->recv();
+        Device* peerDevice = transport->receivedDevice();
+
+        if (peerDevice != nullptr) {
+            PAIRSIM_LOG_DEBUG("Received direct DEVICE {}", peerDevice->getId());
+            counters.received[PacketType::DEVICE].packets.add();
+            if (accountingTraffic) {
+                traffic.packet(PacketType::DEVICE).received++;
+            }
+            if (captureLog != nullptr) {
+                record(capture::RECEIVED, Message{PacketType::DEVICE, Buffer(), peerDevice, peerTickCount});
+            }
+            if (traceLog != nullptr) {
+                traceLog->packet(capture::RECEIVED, PacketType::DEVICE, peerTickCount, 0);
+            }
+            PAIRSIM_PROBE4(packet__recv, (char) role, (int) PacketType::DEVICE, (std::size_t) 0, peerTickCount);
+            handleDirectDevice(peerDevice);
+            return PacketType::DEVICE;
+        }
+
+        const std::uint64_t start = accountingTraffic ? TraceLog::now() : 0;
+        msg = packet::decode(buf.data, buf.size);
+        const PacketType packetType = PacketType(msg["_t"].get<std::uint8_t>());
+        counters.received[packetType].packets.add();
+        counters.received[packetType].bytes.add(buf.size);
+
+        if (accountingTraffic) {
+            lastReceivedSize = buf.size;
+            lastDecodeTime = TraceLog::now() - start;
+
+            TrafficCounts& c = traffic.packet(packetType);
+            c.received++;
+            c.receivedBytes += buf.size;
+            c.decodeTime += lastDecodeTime;
+        }
+
+        if (captureLog != nullptr) {
+            captureLog->append(capture::RECEIVED, packetType, peerTickCount, buf.data, buf.size);
+        }
+        if (traceLog != nullptr) {
+            traceLog->packet(capture::RECEIVED, packetType, peerTickCount, buf.size);
+        }
+        PAIRSIM_PROBE4(packet__recv, (char) role, (int) packetType, buf.size, peerTickCount);
+        return packetType;
+    }
+
+    /**
+     * Opens the capture log, if one was asked for, and names this node
+     * in the trace.
+     * \param _role Which side of the pair this node is.
+     */
+    void startCapture(capture::Role _role) {
+        role = _role;
+        if (!capturePath.empty()) {
+            captureLog.reset(new CaptureLog(capturePath, role, *clock));
+        }
+        if (traceLog != nullptr) {
+            traceLog->setRole(role);
+        }
+    }
+
+    /**
+     * Tick index a phase works on, for tracing: the tick being produced
+     * while stepping and serializing, the one just queued while sending
+     * and the peer's next one while waiting.
+     * \param phase Phase.
+     * \returns Tick index.
+     */
+    std::uint64_t phaseTick(Phase phase) {
+        switch (phase) {
+            case SEND_PHASE:
+                return tickCount > 0 ? tickCount - 1 : 0;
+            case WAIT_PHASE:
+                return peerTickCount;
+            default:
+                return tickCount;
+        }
+    }
+
+    /**
+     * Counter a phase's time adds to while attributing waits.
+     * \param phase Phase.
+     * \returns Counter, null if not needed.
+     */
+    std::uint64_t* phaseElapsed(Phase phase) {
+        return attributing && phase != SETUP_PHASE ? &phaseCycle[phase] : nullptr;
+    }
+
+    /**
+     * Appends a packet to the capture log. Devices handed over in memory
+     * are recorded as the DEVICE packet they stand for.
+     * \param direction Whether it was sent or received.
+     * \param m Packet.
+     */
+    void record(capture::Direction direction, const Message& m) {
+        if (m.device != nullptr) {
+            const Buffer buf = packet::device(m.device);
+            captureLog->append(direction, m.type, m.tick, buf.data(), buf.size());
+        }
+        else {
+            captureLog->append(direction, m.type, m.tick, m.buf.data(), m.buf.size());
+        }
+    }
+
+    /**
+     * Calls the handler of a decoded packet.
+     * \param packetType Packet type.
+     * \param msg JSON message received.
+     */
+    void dispatch(PacketType packetType, const json& msg) {
+        switch (packetType) {
+            case PacketType::ACTION:
+                PAIRSIM_LOG_PACKET(PacketType::ACTION, msg);
+                handleAction(msg);
+                break;
+            case PacketType::DEVICE:
+                PAIRSIM_LOG_PACKET(PacketType::DEVICE, msg);
+                handleDevice(msg);
+                break;
+            case PacketType::DEVICE_ADD:
+                PAIRSIM_LOG_PACKET(PacketType::DEVICE_ADD, msg);
+                handleDeviceAdd(msg);
+                break;
+            case PacketType::END:
+                PAIRSIM_LOG_PACKET(PacketType::END, msg);
+                handleEnd(msg);
+                break;
+            case PacketType::READY:
+                PAIRSIM_LOG_PACKET(PacketType::READY, msg);
+                handleReady(msg);
+                break;
+            case PacketType::NOT_READY:
+                PAIRSIM_LOG_PACKET(PacketType::NOT_READY, msg);
+                handleNotReady(msg);
+                break;
+            case PacketType::TICK:
+                PAIRSIM_LOG_PACKET(PacketType::TICK, msg);
+                handleTick(msg);
+                break;
+            case PacketType::SETUP:
+                PAIRSIM_LOG_PACKET(PacketType::SETUP, msg);
+                handleSetup(msg);
+                break;
+            case PacketType::SUBSCRIBE:
+                PAIRSIM_LOG_PACKET(PacketType::SUBSCRIBE, msg);
+                handleSubscribe(msg);
+                break;
+            case PacketType::REAL_TIME_FACTOR:
+                PAIRSIM_LOG_PACKET(PacketType::REAL_TIME_FACTOR, msg);
+                handleRealTimeFactor(msg);
+                break;
+        }
+    }
+
     /**
      * Handles an ACTION packet.
      * \param msg JSON message received.
@@ -267,6 +1523,8 @@ protected:
             throw std::runtime_error("Caca");
         }
 
+        PAIRSIM_PROBE3(action__dispatch, (char) role, cb->first.c_str(), peerTickCount);
+        TraceSpan span{traceLog, "action", cb->first.c_str(), peerTickCount};
         cb->second(msg["d"]);
     }
 
@@ -275,12 +1533,49 @@ protected:
      * \param msg JSON message received.
      */
     void handleDevice(json msg) {
+        const std::uint64_t start = accountingTraffic ? TraceLog::now() : 0;
         const std::string deviceType = msg["_d"];
         const std::uint32_t id = msg["_id"];
 
         const auto device = devicesByType[deviceType][id];
 
         device->deserialize(msg["d"]);
+
+        if (msg.contains("_k")) {
+            const json& p = msg["_p"];
+            const json& v = msg["_v"];
+            device->setReceivedReckoning(Reckoning{
+                true,
+                Position{p[0].get<double>(), p[1].get<double>(), p[2].get<double>()},
+                Position{v[0].get<double>(), v[1].get<double>(), v[2].get<double>()},
+                msg["_k"].get<std::uint64_t>()
+            });
+        }
+
+        if (accountingTraffic) {
+            accountDecoded(deviceType, start, lastReceivedSize, lastDecodeTime);
+        }
+    }
+
+    /**
+     * Handles a device handed over by an in-process peer.
+     * \param peerDevice The peer's instance of the device.
+     */
+    void handleDirectDevice(Device* peerDevice) {
+        const std::uint64_t start = accountingTraffic ? TraceLog::now() : 0;
+        const auto device = devicesByType[peerDevice->getDeviceType()][peerDevice->getId()];
+
+        if (!device->copyFrom(*peerDevice)) {
+            device->deserialize(peerDevice->serialize());
+        }
+
+        if (peerDevice->getSentReckoning().valid) {
+            device->setReceivedReckoning(peerDevice->getSentReckoning());
+        }
+
+        if (accountingTraffic) {
+            accountDecoded(peerDevice->getDeviceType(), start, 0, 0);
+        }
     }
 
     /**
@@ -310,11 +1605,38 @@ protected:
     virtual void handleNotReady(json msg) = 0;
 
     /**
-     * Handles a TICK packet.
+     * Delay before answering a NOT_READY with another READY.
+     */
+    virtual std::chrono::milliseconds getRetryDelay() = 0;
+
+    /**
+     * Handles a TICK packet, moving dead reckoned devices that got no
+     * update on the peer's tick along.
      * \param JSON message received.
      */
     void handleTick(json msg) {
-        // no-op
+        const std::uint64_t tick = peerTickCount++;
+        counters.peerTicks.add();
+
+        if (attributing && msg.contains("w") && msg.contains("wt")) {
+            // the server gets the client's times for a tick before its
+            // own wait for that tick is over, so they may have to wait
+            const json& w = msg["w"];
+            peerPhaseCycle[STEP_PHASE] = w[0].get<std::uint64_t>();
+            peerPhaseCycle[SERIALIZE_PHASE] = w[1].get<std::uint64_t>();
+            peerPhaseCycle[SEND_PHASE] = w[2].get<std::uint64_t>();
+            peerPhaseCycle[WAIT_PHASE] = w[3].get<std::uint64_t>();
+            peerCycleTick = msg["wt"].get<std::uint64_t>();
+            peerCyclePending = true;
+            attributeCycle();
+        }
+
+        for (size_t i = 0; i < devices.size(); i++) {
+            const Reckoning& r = devices[i]->getReceivedReckoning();
+            if (r.valid && r.tick < tick) {
+                devices[i]->extrapolate(r.predict(tick), r.vel);
+            }
+        }
     }
 
     /**
@@ -325,6 +1647,32 @@ protected:
         // no-op
     }
 
+    /**
+     * Handles a SUBSCRIBE packet, replacing the peer's subscription.
+     * \param JSON message received.
+     */
+    void handleSubscribe(json msg) {
+        peerSubscription = Subscription::fromJson(msg["d"]);
+    }
+
+    /**
+     * Handles a REAL_TIME_FACTOR packet, agreeing on a factor anew.
+     * \param JSON message received.
+     */
+    void handleRealTimeFactor(json msg) {
+        const double factor = msg["d"].get<double>();
+        peerRealTimeFactor = factor < 0 ? -1 : factor;
+        agreeRealTimeFactor();
+    }
+
+    /**
+     * Creates the transport matching the address scheme.
+     * \returns Transport instance, not yet connected.
+     */
+    std::unique_ptr<Transport> makeTransport() {
+        return ps::makeTransport(address);
+    }
+
     /**
      * Checks whether all needed parameters are set.
      */
@@ -336,6 +1684,17 @@ protected:
             throw std::runtime_error("model should be set.");
         }
     }
+
+#ifdef __cpp_impl_coroutine
+    /**
+     * Checks whether the event loop is set, for the awaitable API.
+     */
+    void checkLoop() {
+        if (loop == nullptr) {
+            throw std::runtime_error("event loop should be set.");
+        }
+    }
+#endif
 };
 
 }
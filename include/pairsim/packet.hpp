@@ -9,6 +9,9 @@ using json = nlohmann::json;
 // Internal classes
 #include "./buffer.hpp"
 #include "./packet_type.hpp"
+#include "./device.hpp"
+#include "./subscription.hpp"
+#include "./timing.hpp"
 
 namespace ps { namespace packet {
 
@@ -16,42 +19,72 @@ namespace ps { namespace packet {
  * Encodes a JSON object into a buffer.
  * Currently using CBOR encoding.
  */
-static Buffer encode(json j) {
+inline Buffer encode(json j) {
     return json::to_cbor(j);
 }
 
 /**
  * Decodes a byte array into a JSON object.
- * Currently using CBOR encoding.
+ * Currently using CBOR encoding. The bytes are parsed in place.
  */
-static json decode(std::uint8_t* buf, std::uint32_t size) {
-    Buffer output(buf, buf + size);
-    return json::from_cbor(output);
+inline json decode(const std::uint8_t* buf, std::size_t size) {
+    return json::from_cbor(buf, buf + size);
 }
 
 /**
- * Creates a DEVICE packet.
+ * Creates a DEVICE packet from already serialized data.
+ * \param device Device whose data is to be sent.
+ * \param data Result of the device's serialize().
+ */
+template <typename DevicePtrType>
+inline Buffer device(DevicePtrType device, json data) {
+    json j;
+
+    j["_t"] = PacketType::DEVICE;
+    j["_d"] = device->getDeviceType();
+    j["_id"] = device->getId();
+    j["d"] = std::move(data);
+
+    return encode(j);
+}
+
+/**
+ * Creates a DEVICE packet carrying dead reckoning state.
  * \param device Device whose data is to be sent.
+ * \param data Result of the device's serialize().
+ * \param reckoning Position and velocity on the current tick.
  */
 template <typename DevicePtrType>
-static Buffer device(DevicePtrType device) {
+inline Buffer device(DevicePtrType device, json data, const Reckoning& reckoning) {
     json j;
 
     j["_t"] = PacketType::DEVICE;
     j["_d"] = device->getDeviceType();
     j["_id"] = device->getId();
-    j["d"] = device->serialize();
+    j["_k"] = reckoning.tick;
+    j["_p"] = {reckoning.pos.x, reckoning.pos.y, reckoning.pos.z};
+    j["_v"] = {reckoning.vel.x, reckoning.vel.y, reckoning.vel.z};
+    j["d"] = std::move(data);
 
     return encode(j);
 }
 
+/**
+ * Creates a DEVICE packet.
+ * \param device Device whose data is to be sent.
+ */
+template <typename DevicePtrType>
+inline Buffer device(DevicePtrType device) {
+    return packet::device<DevicePtrType>(device, device->serialize());
+}
+
 /**
  * Creates a DEVICE_ADD packet.
  * This packet should only be sent by the client.
  * \param device Device thats being added.
  */
 template <typename DevicePtrType>
-static Buffer deviceAdd(DevicePtrType device) {
+inline Buffer deviceAdd(DevicePtrType device) {
     json j;
 
     j["_t"] = PacketType::DEVICE_ADD;
@@ -66,7 +99,7 @@ static Buffer deviceAdd(DevicePtrType device) {
  * \param actionName Action name.
  * \param params Action parameters as a JSON object.
  */
-static Buffer action(std::string actionName, json params) {
+inline Buffer action(std::string actionName, json params) {
     json j;
 
     j["_t"] = PacketType::ACTION;
@@ -79,7 +112,7 @@ static Buffer action(std::string actionName, json params) {
 /**
  * Creates an END packet.
  */
-static Buffer end() {
+inline Buffer end() {
     json j;
 
     j["_t"] = PacketType::END;
@@ -90,7 +123,7 @@ static Buffer end() {
 /**
  * Creates a TICK packet.
  */
-static Buffer tick() {
+inline Buffer tick() {
     json j;
 
     j["_t"] = PacketType::TICK;
@@ -98,10 +131,27 @@ static Buffer tick() {
     return encode(j);
 }
 
+/**
+ * Creates a TICK packet carrying the sender's time per phase over its
+ * last whole cycle, for wait attribution.
+ * \param phases Time per phase, in ns.
+ * \param cycleTick Tick the cycle is about, so that the receiver pairs
+ * it with its own cycle for the same tick.
+ */
+inline Buffer tick(const std::uint64_t (&phases)[PHASE_COUNT], std::uint64_t cycleTick) {
+    json j;
+
+    j["_t"] = PacketType::TICK;
+    j["w"] = {phases[STEP_PHASE], phases[SERIALIZE_PHASE], phases[SEND_PHASE], phases[WAIT_PHASE]};
+    j["wt"] = cycleTick;
+
+    return encode(j);
+}
+
 /**
  * Creates a READY packet.
  */
-static Buffer ready() {
+inline Buffer ready() {
     json j;
 
     j["_t"] = PacketType::READY;
@@ -113,7 +163,7 @@ static Buffer ready() {
 /**
  * Creates a NOT_READY packet.
  */
-static Buffer not_ready() {
+inline Buffer not_ready() {
     json j;
 
     j["_t"] = PacketType::NOT_READY;
@@ -122,10 +172,37 @@ static Buffer not_ready() {
 }
 #endif
 
+/**
+ * Creates a SUBSCRIBE packet.
+ * \param subscription Devices and fields the sender wants to receive.
+ */
+inline Buffer subscribe(const Subscription& subscription) {
+    json j;
+
+    j["_t"] = PacketType::SUBSCRIBE;
+    j["d"] = subscription.toJson();
+
+    return encode(j);
+}
+
+/**
+ * Creates a REAL_TIME_FACTOR packet.
+ * \param factor Real-time factor the sender asks for, 0 for as fast as
+ * possible.
+ */
+inline Buffer realTimeFactor(double factor) {
+    json j;
+
+    j["_t"] = PacketType::REAL_TIME_FACTOR;
+    j["d"] = factor;
+
+    return encode(j);
+}
+
 /**
  * Creates a SETUP packet.
  */
-static Buffer setup() {
+inline Buffer setup() {
     json j;
 
     j["_t"] = PacketType::SETUP;
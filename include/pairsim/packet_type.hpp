@@ -18,8 +18,36 @@ enum PacketType: std::uint8_t {
     READY = 'R',
     NOT_READY = 'r',
     SETUP = 'S',
+    SUBSCRIBE = 's',
+    REAL_TIME_FACTOR = 'f',
 };
 
+/** Every packet type, e.g. to iterate per type counters. */
+static constexpr PacketType PACKET_TYPES[] = {
+    DEVICE, DEVICE_ADD, ACTION, END, TICK, READY, NOT_READY, SETUP, SUBSCRIBE, REAL_TIME_FACTOR,
+};
+
+/**
+ * Gets a packet type's name, for logs and traces.
+ * \param type Packet type.
+ * \returns Name, e.g. "TICK".
+ */
+inline const char* packetName(PacketType type) {
+    switch (type) {
+        case DEVICE: return "DEVICE";
+        case DEVICE_ADD: return "DEVICE_ADD";
+        case ACTION: return "ACTION";
+        case END: return "END";
+        case TICK: return "TICK";
+        case READY: return "READY";
+        case NOT_READY: return "NOT_READY";
+        case SETUP: return "SETUP";
+        case SUBSCRIBE: return "SUBSCRIBE";
+        case REAL_TIME_FACTOR: return "REAL_TIME_FACTOR";
+    }
+    return "UNKNOWN";
+}
+
 }
 
 #endif // PAIRSIM_PACKET_TYPE_HPP_
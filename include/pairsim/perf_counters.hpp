@@ -0,0 +1,352 @@
+
+#ifndef PAIRSIM_PERF_COUNTERS_HPP_
+#define PAIRSIM_PERF_COUNTERS_HPP_
+
+// Standard lib utilities
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+
+// Linux performance counters
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// Internal classes
+#include "timing.hpp"
+
+namespace ps {
+
+/**
+ * Hardware events counted by PerfCounters.
+ */
+enum PerfEvent {
+    CYCLES_EVENT = 0,
+    INSTRUCTIONS_EVENT = 1,
+
+    /** Last level cache misses. */
+    CACHE_MISSES_EVENT = 2,
+
+    /** Mispredicted branches. */
+    BRANCH_MISSES_EVENT = 3,
+
+    PERF_EVENT_COUNT = 4,
+};
+
+/**
+ * Gets an event's name, for reports.
+ * \param event Event.
+ * \returns Name, e.g. "cycles".
+ */
+inline const char* perfEventName(PerfEvent event) {
+    static const char* const names[PERF_EVENT_COUNT] = {"cycles", "instructions", "cache misses", "branch misses"};
+    return event < PERF_EVENT_COUNT ? names[event] : "unknown";
+}
+
+/**
+ * Events counted during one phase, summed over its spans.
+ */
+struct PerfCounts {
+    /** Times the phase was entered. */
+    std::uint64_t spans;
+
+    /** Counts by PerfEvent, 0 for unavailable events. */
+    std::uint64_t values[PERF_EVENT_COUNT];
+
+    /**
+     * Gets the instructions per cycle.
+     * \returns IPC, 0 without cycles.
+     */
+    double ipc() const {
+        return values[CYCLES_EVENT] > 0 ? (double) values[INSTRUCTIONS_EVENT] / values[CYCLES_EVENT] : 0;
+    }
+
+    /**
+     * Gets an event's count per thousand instructions, e.g. cache MPKI.
+     * \param event Event.
+     * \returns Count per thousand instructions, 0 without instructions.
+     */
+    double perKiloInstruction(PerfEvent event) const {
+        return values[INSTRUCTIONS_EVENT] > 0 ? 1000.0 * values[event] / values[INSTRUCTIONS_EVENT] : 0;
+    }
+};
+
+#ifdef __linux__
+/**
+ * Hardware performance counters of the calling thread, read through
+ * perf_event_open(2) as a single group and aggregated by Phase, see
+ * Node::setPerfCounters. Only user space is counted, so time blocked in
+ * the kernel, e.g. waiting for the peer's TICK, adds nothing: the wait
+ * phase's counts are those of receiving, decoding and handling packets.
+ *
+ * Events the CPU or hypervisor doesn't offer are left out. When the
+ * kernel multiplexes the group with other users of the counters, counts
+ * are scaled by the share of time the group actually ran.
+ */
+class PerfCounters {
+private:
+    /** Event descriptors, -1 for unavailable events. */
+    int fds[PERF_EVENT_COUNT];
+
+    /** Group leader, the first event opened. */
+    int leader;
+
+    /** Position of each event in a group read, -1 if unavailable. */
+    int slots[PERF_EVENT_COUNT];
+    int opened;
+
+    PerfCounts phases[PHASE_COUNT];
+
+public:
+    /**
+     * Opens and starts the counters for the calling thread.
+     * \throws std::runtime_error if no event could be opened, e.g. when
+     * perf_event_paranoid forbids it or in a container or VM without
+     * counters.
+     */
+    PerfCounters() : leader{-1}, opened{0}, phases{} {
+        static const std::uint64_t configs[PERF_EVENT_COUNT] = {
+            PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+            PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES,
+        };
+
+        int error = 0;
+        for (int e = 0; e < PERF_EVENT_COUNT; e++) {
+            perf_event_attr attr;
+            std::memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = configs[e];
+            attr.disabled = leader == -1;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+            fds[e] = (int) syscall(SYS_perf_event_open, &attr, 0, -1, leader, 0);
+            if (fds[e] == -1) {
+                error = errno;
+                slots[e] = -1;
+                continue;
+            }
+            if (leader == -1) {
+                leader = fds[e];
+            }
+            slots[e] = opened++;
+        }
+
+        if (leader == -1) {
+            std::string reason = std::strerror(error);
+            if (error == EACCES || error == EPERM) {
+                reason += ", see /proc/sys/kernel/perf_event_paranoid";
+            }
+            throw std::runtime_error("Could not open hardware performance counters: " + reason);
+        }
+
+        ioctl(leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+        ioctl(leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    }
+
+    PerfCounters(const PerfCounters& rhs) = delete;
+    PerfCounters& operator=(const PerfCounters& rhs) = delete;
+
+    ~PerfCounters() {
+        for (int fd : fds) {
+            if (fd != -1) {
+                close(fd);
+            }
+        }
+    }
+
+    /**
+     * Whether an event is counted.
+     * \param event Event.
+     * \returns `true` if the event could be opened.
+     */
+    bool available(PerfEvent event) const {
+        return slots[event] != -1;
+    }
+
+    /**
+     * Reads the counts since the counters were opened, with a single
+     * system call.
+     * \param values Counts by PerfEvent, scaled for multiplexing.
+     * \returns `false` if the read failed.
+     */
+    bool read(std::uint64_t (&values)[PERF_EVENT_COUNT]) {
+        // nr, time enabled, time running, then a value per event
+        std::uint64_t buf[3 + PERF_EVENT_COUNT];
+        const ssize_t size = ::read(leader, buf, sizeof(buf));
+        if (size < (ssize_t) ((3 + opened) * sizeof(std::uint64_t))) {
+            return false;
+        }
+
+        const std::uint64_t enabled = buf[1];
+        const std::uint64_t running = buf[2];
+        for (int e = 0; e < PERF_EVENT_COUNT; e++) {
+            if (slots[e] == -1 || running == 0) {
+                values[e] = 0;
+            }
+            else if (running < enabled) {
+                values[e] = (std::uint64_t) ((double) buf[3 + slots[e]] * enabled / running);
+            }
+            else {
+                values[e] = buf[3 + slots[e]];
+            }
+        }
+        return true;
+    }
+
+    /**
+     * Adds a span of a phase.
+     * \param phase Phase.
+     * \param start Counts read when the span started.
+     * \param end Counts read when it ended.
+     */
+    void add(Phase phase, const std::uint64_t (&start)[PERF_EVENT_COUNT],
+             const std::uint64_t (&end)[PERF_EVENT_COUNT]) {
+        PerfCounts& c = phases[phase];
+        c.spans++;
+        for (int e = 0; e < PERF_EVENT_COUNT; e++) {
+            // scaled counts may go slightly backwards
+            c.values[e] += end[e] > start[e] ? end[e] - start[e] : 0;
+        }
+    }
+
+    /**
+     * Gets the counts of a phase.
+     * \param phase Phase.
+     * \returns Counts so far.
+     */
+    const PerfCounts& phase(Phase phase) const {
+        return phases[phase];
+    }
+
+    /**
+     * Clears the counts of every phase, e.g. after a warmup.
+     */
+    void reset() {
+        std::fill(phases, phases + PHASE_COUNT, PerfCounts{});
+    }
+
+    /**
+     * Writes the counts by phase as a table, with IPC and misses per
+     * thousand instructions. Unavailable events show as "-".
+     * \param out Stream to write to.
+     */
+    void report(std::ostream& out) const {
+        char line[192];
+        std::snprintf(line, sizeof(line), "%-10s %10s %14s %14s %6s %12s %7s %12s %7s\n", "phase", "spans",
+                      "cycles", "instructions", "IPC", "cache misses", "MPKI", "br misses", "MPKI");
+        out << line;
+
+        for (int p = 0; p < PHASE_COUNT; p++) {
+            const PerfCounts& c = phases[p];
+            char values[PERF_EVENT_COUNT][24];
+            for (int e = 0; e < PERF_EVENT_COUNT; e++) {
+                if (available(PerfEvent(e))) {
+                    std::snprintf(values[e], sizeof(values[e]), "%llu", (unsigned long long) c.values[e]);
+                }
+                else {
+                    std::snprintf(values[e], sizeof(values[e]), "-");
+                }
+            }
+
+            std::snprintf(line, sizeof(line), "%-10s %10llu %14s %14s %6.2f %12s %7.2f %12s %7.2f\n",
+                          phaseName(Phase(p)), (unsigned long long) c.spans, values[CYCLES_EVENT],
+                          values[INSTRUCTIONS_EVENT], c.ipc(), values[CACHE_MISSES_EVENT],
+                          c.perKiloInstruction(CACHE_MISSES_EVENT), values[BRANCH_MISSES_EVENT],
+                          c.perKiloInstruction(BRANCH_MISSES_EVENT));
+            out << line;
+        }
+    }
+};
+
+/**
+ * Counts hardware events from its creation to its destruction into a
+ * phase, if counters are open.
+ */
+class PerfSpan {
+private:
+    PerfCounters* counters;
+    Phase phase;
+    std::uint64_t start[PERF_EVENT_COUNT];
+
+public:
+    /**
+     * Starts a span.
+     * \param _counters Node's counters, may be null.
+     * \param _phase Phase.
+     */
+    PerfSpan(PerfCounters* _counters, Phase _phase) : counters{_counters}, phase{_phase} {
+        if (counters != nullptr && !counters->read(start)) {
+            counters = nullptr;
+        }
+    }
+
+    PerfSpan(const PerfSpan& rhs) = delete;
+    PerfSpan& operator=(const PerfSpan& rhs) = delete;
+
+    ~PerfSpan() {
+        std::uint64_t end[PERF_EVENT_COUNT];
+        if (counters != nullptr && counters->read(end)) {
+            counters->add(phase, start, end);
+        }
+    }
+};
+#else
+/**
+ * Stands in for PerfCounters where perf_event_open(2) doesn't exist, e.g.
+ * off Linux: opening always fails, so nodes run on without counters.
+ */
+class PerfCounters {
+private:
+    PerfCounts none;
+
+public:
+    /**
+     * \throws std::runtime_error always.
+     */
+    PerfCounters() : none{} {
+        throw std::runtime_error("Hardware performance counters are only available on Linux");
+    }
+
+    bool available(PerfEvent event) const {
+        return false;
+    }
+
+    bool read(std::uint64_t (&values)[PERF_EVENT_COUNT]) {
+        return false;
+    }
+
+    void add(Phase phase, const std::uint64_t (&start)[PERF_EVENT_COUNT],
+             const std::uint64_t (&end)[PERF_EVENT_COUNT]) {}
+
+    const PerfCounts& phase(Phase phase) const {
+        return none;
+    }
+
+    void reset() {}
+
+    void report(std::ostream& out) const {}
+};
+
+/**
+ * Stands in for PerfSpan off Linux, so that phases cost nothing extra.
+ */
+class PerfSpan {
+public:
+    PerfSpan(PerfCounters* counters, Phase phase) {}
+};
+#endif
+
+}
+
+#endif // PAIRSIM_PERF_COUNTERS_HPP_
@@ -0,0 +1,18 @@
+#ifndef PAIRSIM_POSITION_HPP_
+#define PAIRSIM_POSITION_HPP_
+
+namespace ps {
+
+/**
+ * Position of a device in the simulation's own units and frame,
+ * used for spatial interest filtering.
+ */
+struct Position {
+    double x;
+    double y;
+    double z;
+};
+
+}
+
+#endif // PAIRSIM_POSITION_HPP_
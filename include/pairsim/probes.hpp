@@ -0,0 +1,47 @@
+
+#ifndef PAIRSIM_PROBES_HPP_
+#define PAIRSIM_PROBES_HPP_
+
+/**
+ * USDT static tracepoints on the hot paths, under the "pairsim" provider.
+ * Each probe compiles to a single nop plus an ELF note describing where its
+ * arguments live, so a detached probe costs nothing beyond evaluating its
+ * (cheap) arguments. Tools such as bpftrace, perf or SystemTap patch the nop
+ * when attaching, letting live co-simulations be traced without rebuilding.
+ *
+ * Probes are built in whenever <sys/sdt.h> is found (systemtap-sdt-dev on
+ * Debian based systems), unless PAIRSIM_PROBES_DISABLED is defined. Every
+ * probe starts with the node's role, 'c' or 's':
+ *
+ *  - tick__begin(role, tick): getData() starts producing a tick.
+ *  - tick__end(role, tick): sendData() is done flushing that tick.
+ *  - model__step__begin(role, tick), model__step__end(role, tick).
+ *  - packet__send(role, type, size, tick): a packet is handed to the
+ *    transport, size being 0 for devices handed over in memory.
+ *  - packet__recv(role, type, size, tick): a packet was received, tick
+ *    being the peer's.
+ *  - action__dispatch(role, name, tick): an action callback is about to run.
+ *  - device__add(role, type, id): a device was added or is being monitored.
+ *
+ * E.g. bytes sent by packet type of a running server:
+ *
+ *     bpftrace -p PID -e 'usdt:*:pairsim:packet__send /arg0 == 115/ { @[arg1] = sum(arg2); }'
+ */
+#if !defined(PAIRSIM_PROBES_DISABLED) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define PAIRSIM_PROBES_ENABLED
+#endif
+#endif
+
+#ifdef PAIRSIM_PROBES_ENABLED
+#define PAIRSIM_PROBE2(name, a, b) DTRACE_PROBE2(pairsim, name, a, b)
+#define PAIRSIM_PROBE3(name, a, b, c) DTRACE_PROBE3(pairsim, name, a, b, c)
+#define PAIRSIM_PROBE4(name, a, b, c, d) DTRACE_PROBE4(pairsim, name, a, b, c, d)
+#else
+#define PAIRSIM_PROBE2(name, a, b) do {} while (0)
+#define PAIRSIM_PROBE3(name, a, b, c) do {} while (0)
+#define PAIRSIM_PROBE4(name, a, b, c, d) do {} while (0)
+#endif
+
+#endif // PAIRSIM_PROBES_HPP_
@@ -0,0 +1,241 @@
+
+#ifndef PAIRSIM_REPLAY_HPP_
+#define PAIRSIM_REPLAY_HPP_
+
+// Standard lib utilities
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <string>
+
+// JSON handling
+#include <json.hpp>
+using json = nlohmann::json;
+
+// Internal classes
+#include "capture.hpp"
+#include "clock.hpp"
+#include "packet.hpp"
+#include "packet_type.hpp"
+#include "transport.hpp"
+#include "transport_factory.hpp"
+#include "logger.hpp"
+
+namespace ps {
+
+/**
+ * Stands in for a recorded Client or Server, playing its capture log
+ * (see Node::setCaptureFile) back to a live peer. Recorded packets are
+ * sent as they were; received ones that mark lockstep progress (READY,
+ * SETUP, TICK, END) are waited for from the live peer before going on,
+ * and anything else the peer sends is drained.
+ *
+ * The live peer must create the same devices in the same order as the
+ * one in the recording, so that device IDs line up.
+ */
+class ReplayPeer {
+private:
+    /** Recorded log. */
+    CaptureReader reader;
+
+    /** Address to dial or listen on, as the recorded node did. */
+    std::string address;
+
+    /** Playback speed relative to the recording, 0 for maximum. */
+    double speed;
+
+    /** Link to the live peer. */
+    std::unique_ptr<Transport> transport;
+
+    /** Number of packets sent to the live peer. */
+    std::uint64_t sent;
+
+    /** Number of packets received from the live peer. */
+    std::uint64_t received;
+
+    /** Time source of the pacing and retry delays. */
+    Clock* clock;
+
+    /** Delay before answering a NOT_READY with another READY. */
+    std::chrono::milliseconds retryDelay;
+
+public:
+    /**
+     * Creates a replay peer.
+     * \param path Capture log to be played.
+     * \param _address Address the recorded node would use.
+     */
+    ReplayPeer(const std::string& path, std::string _address)
+        : reader{path}, address{_address}, speed{0}, transport{nullptr}, sent{0}, received{0},
+          clock{&SteadyClock::instance()},
+          // the recorded node's own default, see Client and Server
+          retryDelay{reader.getRole() == capture::CLIENT ? 1000 : 500} {}
+
+    /**
+     * Sets the playback speed.
+     * \param _speed 1 to keep the recorded timing, 2 for twice as fast
+     * and so on; 0 (the default) sends as fast as the peer keeps up.
+     */
+    void setSpeed(double _speed) {
+        speed = _speed > 0 ? _speed : 0;
+    }
+
+    /**
+     * Sets the clock playback is paced by, usually the live peer's (see
+     * Node::setClock).
+     * \param _clock Clock, which must outlive the replay.
+     */
+    void setClock(Clock* _clock) {
+        clock = _clock;
+    }
+
+    /**
+     * Sets the retry delay, waited before asking a live peer that
+     * answered NOT_READY again. Defaults to that of the recorded node.
+     * \param _retryDelay Retry delay.
+     */
+    void setRetryDelay(std::chrono::milliseconds _retryDelay) {
+        retryDelay = _retryDelay;
+    }
+
+    /**
+     * Gets the retry delay.
+     * \returns Delay between ready checks with the live peer.
+     */
+    std::chrono::milliseconds getRetryDelay() {
+        return retryDelay;
+    }
+
+    /**
+     * Gets the number of packets sent to the live peer.
+     * \returns Packet count.
+     */
+    std::uint64_t getSentCount() {
+        return sent;
+    }
+
+    /**
+     * Gets the number of packets received from the live peer.
+     * \returns Packet count.
+     */
+    std::uint64_t getReceivedCount() {
+        return received;
+    }
+
+    /**
+     * Connects and plays the whole log, blocking until it ends or the
+     * live peer sends an END.
+     */
+    void run() {
+        transport = makeTransport(address);
+        if (reader.getRole() == capture::CLIENT) {
+            PAIRSIM_LOG_DEBUG("Replaying client, dialing");
+            transport->dial(address);
+        }
+        else {
+            PAIRSIM_LOG_DEBUG("Replaying server, listening");
+            transport->listen(address);
+        }
+
+        const auto start = clock->now();
+        // how much the live peer delayed us past the recorded timing
+        std::chrono::nanoseconds lag{0};
+        bool pending = false;
+
+        CaptureReader::Record r;
+        reader.rewind();
+
+        while (reader.next(r)) {
+            const std::chrono::nanoseconds recorded{(std::int64_t) (r.header.time / (speed > 0 ? speed : 1))};
+
+            if (r.header.direction == capture::SENT) {
+                if (speed > 0) {
+                    const auto due = start + recorded + lag;
+                    if (due > clock->now()) {
+                        if (pending) {
+                            transport->flush();
+                            pending = false;
+                        }
+                        clock->sleepUntil(due);
+                    }
+                }
+
+                transport->send(r.bytes, r.header.size);
+                pending = true;
+                sent++;
+
+                if (r.header.type == PacketType::END) {
+                    break;
+                }
+                continue;
+            }
+
+            if (!isSyncPoint(PacketType(r.header.type))) {
+                continue;
+            }
+
+            if (pending) {
+                transport->flush();
+                pending = false;
+            }
+            if (!waitFor(PacketType(r.header.type))) {
+                break;
+            }
+
+            if (speed > 0) {
+                lag = std::max(lag, clock->now() - start - recorded);
+            }
+        }
+
+        if (pending) {
+            transport->flush();
+        }
+        PAIRSIM_LOG_DEBUG("Replay done");
+    }
+
+private:
+    /**
+     * Whether a received packet type marks lockstep progress.
+     */
+    static bool isSyncPoint(PacketType type) {
+        return type == PacketType::READY || type == PacketType::SETUP
+            || type == PacketType::TICK || type == PacketType::END;
+    }
+
+    /**
+     * Drains packets from the live peer until one of a type arrives.
+     * \param type Packet type to be waited.
+     * \returns `false` if the peer ended the session instead.
+     */
+    bool waitFor(PacketType type) {
+        for (;;) {
+            const BufferView buf = transport->recv();
+            received++;
+
+            if (transport->receivedDevice() != nullptr) {
+                continue;
+            }
+
+            const json msg = packet::decode(buf.data, buf.size);
+            const PacketType got = PacketType(msg["_t"].get<std::uint8_t>());
+
+            if (got == type) {
+                return true;
+            }
+            if (got == PacketType::END) {
+                return false;
+            }
+            if (got == PacketType::NOT_READY) {
+                // the recorded peer was let in right away, keep asking
+                clock->sleepFor(retryDelay);
+                const Buffer ready = packet::ready();
+                transport->send(ready.data(), ready.size());
+                transport->flush();
+            }
+        }
+    }
+};
+
+}
+
+#endif // PAIRSIM_REPLAY_HPP_
@@ -8,14 +8,6 @@
 #include "node.hpp"
 #include "server_model.hpp"
 
-// Debugging log
-#ifdef PAIRSIM_DEBUG_ENABLED
-#include <iostream>
-#define PAIRSIM_DEBUG(str) std::cout << "[PS] " << str << std::endl
-#else
-#define PAIRSIM_DEBUG(str)
-#endif
-
 namespace ps {
 
 template <typename DurationType=std::chrono::milliseconds, typename DevicePtrType=std::shared_ptr<Device>>
@@ -63,10 +55,11 @@ public:
      * \param d Device to be added.
      */
     void monitorDevice(DevicePtrType d) {
-        PAIRSIM_DEBUG("Monitoring device " << d->getId());
+        PAIRSIM_LOG_DEBUG("Monitoring device {}", d->getId());
         if (d == nullptr) {
             throw std::runtime_error("Caca 3");
         }
+        PAIRSIM_PROBE3(device__add, (char) this->role, d->getDeviceType().c_str(), d->getId());
 
         this->devices.push_back(d);
         this->devicesByType[d->getDeviceType()][d->getId()] = d;
@@ -78,50 +71,117 @@ public:
      */
     void setup() {
         this->state = State::SETTING_UP;
+        PAIRSIM_TIME_PHASE(SETUP_PHASE);
+        PAIRSIM_PHASE_HOOKS(SETUP_PHASE);
         this->checkParams();
 
-        PAIRSIM_DEBUG("Listening...");
-        this->sock.listen(this->address.c_str());
+        PAIRSIM_LOG_DEBUG("Listening...");
+        this->transport = this->makeTransport();
+        this->transport->listen(this->address);
         this->running = true;
+        this->queueSettings();
+        this->startCapture(capture::SERVER);
 
-        PAIRSIM_DEBUG("Waiting for SETUP");
+        PAIRSIM_LOG_DEBUG("Waiting for SETUP");
         this->waitFor(PacketType::SETUP);
 
-        PAIRSIM_DEBUG("OK, now setting up this side");
+        PAIRSIM_LOG_DEBUG("OK, now setting up this side");
         this->model->setup(this);
-        this->queue.push(packet::setup());
+        this->enqueue(PacketType::SETUP, packet::setup());
         this->flush();
         this->state = State::SHOULD_WAIT_TICK;
     }
 
+#ifdef __cpp_impl_coroutine
+    /**
+     * Awaitable version of setup(). Suspends on the event loop while
+     * waiting for the client's SETUP.
+     */
+    Task setupAsync() {
+        this->state = State::SETTING_UP;
+        PAIRSIM_TIME_PHASE(SETUP_PHASE);
+        PAIRSIM_PHASE_HOOKS(SETUP_PHASE);
+        this->checkParams();
+        this->checkLoop();
+
+        PAIRSIM_LOG_DEBUG("Listening...");
+        this->transport = this->makeTransport();
+        this->transport->listen(this->address);
+        this->running = true;
+        this->queueSettings();
+        this->startCapture(capture::SERVER);
+
+        co_await this->waitForAsync(PacketType::SETUP);
+
+        this->model->setup(this);
+        this->enqueue(PacketType::SETUP, packet::setup());
+        this->flush();
+        this->state = State::SHOULD_WAIT_TICK;
+    }
+
+    /**
+     * Awaitable version of waitTick().
+     */
+    Task waitTickAsync() {
+        this->state = State::WAITING_TICK;
+        PAIRSIM_TIME_PHASE(WAIT_PHASE);
+        PAIRSIM_PHASE_HOOKS(WAIT_PHASE);
+        PAIRSIM_LOG_DEBUG("Waiting TICK");
+        co_await this->waitForAsync(PacketType::TICK);
+        this->state = State::SHOULD_GET_DATA;
+    }
+#endif
+
     void waitTick() {
         this->state = State::WAITING_TICK;
-        PAIRSIM_DEBUG("Waiting TICK");
+        PAIRSIM_TIME_PHASE(WAIT_PHASE);
+        PAIRSIM_PHASE_HOOKS(WAIT_PHASE);
+        PAIRSIM_LOG_DEBUG("Waiting TICK");
         this->waitFor(PacketType::TICK);
         this->state = State::SHOULD_GET_DATA;
     }
 
     void getData() {
         this->state = State::GETTING_DATA;
-        PAIRSIM_DEBUG("Now getting this side's data");
-        this->model->step(this);
+        PAIRSIM_LOG_DEBUG("Now getting this side's data");
+        PAIRSIM_PROBE2(tick__begin, (char) this->role, this->tickCount);
+        this->closeCycle();
+        {
+            PAIRSIM_TIME_PHASE(STEP_PHASE);
+            PAIRSIM_PHASE_HOOKS(STEP_PHASE);
+            PAIRSIM_PROBE2(model__step__begin, (char) this->role, this->tickCount);
+            this->model->step(this);
+            PAIRSIM_PROBE2(model__step__end, (char) this->role, this->tickCount);
+        }
 
-        for (size_t i = 0; i < this->devices.size(); i++) {
-            this->queue.push(packet::device<DevicePtrType>(this->devices[i]));
+        {
+            PAIRSIM_TIME_PHASE(SERIALIZE_PHASE);
+            PAIRSIM_PHASE_HOOKS(SERIALIZE_PHASE);
+            this->queueDeviceUpdates();
         }
 
-        this->queue.push(packet::tick());
+        this->queueTick();
         this->state = State::SHOULD_SEND_DATA;
     }
 
     void sendData() {
         this->state = State::SENDING_DATA;
-        PAIRSIM_DEBUG("Now sending this side's data");
+        PAIRSIM_TIME_PHASE(SEND_PHASE);
+        PAIRSIM_PHASE_HOOKS(SEND_PHASE);
+        PAIRSIM_LOG_DEBUG("Now sending this side's data");
         this->flush();
+        PAIRSIM_PROBE2(tick__end, (char) this->role, this->tickCount - 1);
         this->state = State::SHOULD_WAIT_TICK;
     }
 
 private:
+    /**
+     * Delay before answering a NOT_READY with another READY.
+     */
+    std::chrono::milliseconds getRetryDelay() {
+        return std::chrono::milliseconds(500);
+    }
+
     /**
      * Handles a DEVICE_ADD packet.
      * \param msg JSON message received.
@@ -140,11 +200,11 @@ private:
      */
     void handleReady(json msg) {
         if (this->model->ready()) {
-            this->queue.push(packet::ready());
+            this->enqueue(PacketType::READY, packet::ready());
             this->flush();
         }
         else {
-            this->queue.push(packet::not_ready());
+            this->enqueue(PacketType::NOT_READY, packet::not_ready());
             this->flush();
         }
     }
@@ -154,8 +214,8 @@ private:
      * \param JSON message received.
      */
     void handleNotReady(json msg) {
-        std::this_thread::sleep_for(std::chrono::milliseconds(500));
-        this->queue.push(packet::ready());
+        this->clock->sleepFor(getRetryDelay());
+        this->enqueue(PacketType::READY, packet::ready());
         this->flush();
     }
 };
@@ -0,0 +1,429 @@
+
+#ifndef PAIRSIM_SHM_TRANSPORT_HPP_
+#define PAIRSIM_SHM_TRANSPORT_HPP_
+
+// Standard lib utilities
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+// POSIX shared memory and Linux futexes
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+// Internal classes
+#include "transport.hpp"
+
+namespace ps {
+
+/**
+ * Same-host transport over a POSIX shared memory segment, selected with
+ * "shm://name" addresses. The segment holds one single-producer
+ * single-consumer ring per direction; messages are written straight
+ * into the ring and decoded in place by the receiver, and a futex is
+ * only touched when the other side is actually sleeping.
+ *
+ * The listener creates (and later unlinks) the segment, so the server
+ * must be up before the client dials, as with NNG.
+ */
+class ShmTransport : public Transport {
+public:
+    /** Address prefix that selects this transport. */
+    static constexpr const char* SCHEME = "shm://";
+
+    /** Default capacity of each ring, in bytes. */
+    static constexpr std::size_t DEFAULT_CAPACITY = 1 << 22;
+
+private:
+    static constexpr std::uint32_t MAGIC = 0x50534d31; // "PSM1"
+    static constexpr std::uint32_t WRAP = 0xffffffff;
+    static constexpr std::size_t RECORD_HEADER = 8;
+    static constexpr int SPIN_COUNT = 4096;
+
+    /** Times dial() looks for a set up segment before giving up. */
+    static constexpr int DIAL_ATTEMPTS = 100;
+    static constexpr std::chrono::milliseconds DIAL_RETRY_DELAY{10};
+
+    /**
+     * Ring control block. Positions grow monotonically and are taken
+     * modulo the capacity; each counter lives on its own cache line.
+     */
+    struct Ring {
+        alignas(64) std::atomic<std::uint64_t> head;
+        alignas(64) std::atomic<std::uint64_t> tail;
+        alignas(64) std::atomic<std::uint32_t> dataSeq;
+        std::atomic<std::uint32_t> dataWaiters;
+        alignas(64) std::atomic<std::uint32_t> spaceSeq;
+        std::atomic<std::uint32_t> spaceWaiters;
+    };
+
+    /** Segment header, followed by both rings and their data areas. */
+    struct Header {
+        std::atomic<std::uint32_t> magic;
+        std::atomic<std::uint32_t> closed;
+        std::uint64_t capacity;
+        Ring rings[2];
+    };
+
+    static_assert(std::atomic<std::uint64_t>::is_always_lock_free,
+                  "shared memory rings need lock-free 64-bit atomics");
+
+    /** Ring capacity, a power of two. */
+    std::size_t capacity;
+
+    /** Shared memory object name. */
+    std::string name;
+
+    /** Whether this side created the segment. */
+    bool owner;
+
+    /** Mapped segment. */
+    Header* header;
+
+    /** Mapped segment size. */
+    std::size_t mappedSize;
+
+    /** Ring this side writes to. */
+    Ring* out;
+
+    /** Ring this side reads from. */
+    Ring* in;
+
+    /** Data area of the outgoing ring. */
+    std::uint8_t* outData;
+
+    /** Data area of the incoming ring. */
+    std::uint8_t* inData;
+
+    /** Bytes of the last received record, released on the next recv(). */
+    std::uint64_t pendingRelease;
+
+public:
+    /**
+     * Creates a shared memory transport.
+     * \param _capacity Capacity of each ring in bytes, rounded up to a
+     * power of two. Only the listener's value is used.
+     */
+    ShmTransport(std::size_t _capacity=DEFAULT_CAPACITY)
+        : capacity{roundCapacity(_capacity)}, name{""}, owner{false}, header{nullptr},
+          mappedSize{0}, out{nullptr}, in{nullptr}, outData{nullptr}, inData{nullptr},
+          pendingRelease{0} {}
+
+    /**
+     * Destroys the transport, waking a blocked peer and unmapping
+     * the segment.
+     */
+    ~ShmTransport() {
+        if (header != nullptr) {
+            header->closed.store(1, std::memory_order_release);
+            wake(&header->rings[0].dataSeq);
+            wake(&header->rings[1].dataSeq);
+            wake(&header->rings[0].spaceSeq);
+            wake(&header->rings[1].spaceSeq);
+            munmap(header, mappedSize);
+        }
+        if (owner) {
+            shm_unlink(name.c_str());
+        }
+    }
+
+    void listen(const std::string& address) {
+        name = objectName(address);
+        mappedSize = segmentSize(capacity);
+
+        shm_unlink(name.c_str());
+        const int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+        if (fd < 0) {
+            throw std::runtime_error("shm_open failed for " + name + ": " + std::strerror(errno));
+        }
+        owner = true;
+
+        if (ftruncate(fd, mappedSize) != 0) {
+            close(fd);
+            throw std::runtime_error("ftruncate failed for " + name + ": " + std::strerror(errno));
+        }
+
+        map(fd);
+        new (header) Header{};
+        header->capacity = capacity;
+        header->magic.store(MAGIC, std::memory_order_release);
+
+        attach(1);
+    }
+
+    void dial(const std::string& address) {
+        name = objectName(address);
+
+        // the listener creates, sizes and stamps the segment in separate
+        // steps, so a dialer racing it may see it half set up
+        for (int attempt = 1; !tryMap(address); attempt++) {
+            if (attempt == DIAL_ATTEMPTS) {
+                throw std::runtime_error("invalid shm segment " + name);
+            }
+            std::this_thread::sleep_for(DIAL_RETRY_DELAY);
+        }
+
+        capacity = header->capacity;
+        if (mappedSize < segmentSize(capacity)) {
+            unmap();
+            throw std::runtime_error("invalid shm segment " + name);
+        }
+
+        attach(0);
+    }
+
+    void send(const std::uint8_t* data, std::size_t size) {
+        const std::uint64_t record = recordSize(size);
+        if (record > capacity / 2) {
+            throw std::runtime_error("message too large for shm ring");
+        }
+
+        std::uint64_t head = out->head.load(std::memory_order_relaxed);
+        const std::uint64_t offset = head & (capacity - 1);
+        const std::uint64_t contiguous = capacity - offset;
+        const std::uint64_t needed = record > contiguous ? record + contiguous : record;
+
+        waitForSpace(head, needed);
+
+        if (record > contiguous) {
+            writeHeader(outData + offset, WRAP);
+            head += contiguous;
+        }
+
+        std::uint8_t* slot = outData + (head & (capacity - 1));
+        writeHeader(slot, size);
+        std::memcpy(slot + RECORD_HEADER, data, size);
+
+        out->head.store(head + record, std::memory_order_release);
+        out->dataSeq.fetch_add(1, std::memory_order_release);
+        if (out->dataWaiters.load(std::memory_order_seq_cst) != 0) {
+            wake(&out->dataSeq);
+        }
+    }
+
+    BufferView recv() {
+        std::uint64_t tail = in->tail.load(std::memory_order_relaxed);
+
+        if (pendingRelease != 0) {
+            tail += pendingRelease;
+            pendingRelease = 0;
+            release(tail);
+        }
+
+        for (;;) {
+            waitForData(tail);
+
+            const std::uint8_t* slot = inData + (tail & (capacity - 1));
+            std::uint32_t size;
+            std::memcpy(&size, slot, sizeof(size));
+
+            if (size == WRAP) {
+                tail += capacity - (tail & (capacity - 1));
+                release(tail);
+                continue;
+            }
+
+            pendingRelease = recordSize(size);
+            return BufferView{slot + RECORD_HEADER, size};
+        }
+    }
+
+private:
+    /**
+     * Opens and maps the listener's segment, if it is fully set up.
+     * \param address Address dialed, for errors.
+     * \returns `false`, with nothing mapped, if the segment is still too
+     * small or not stamped yet.
+     * \throws std::runtime_error if there is no listener.
+     */
+    bool tryMap(const std::string& address) {
+        const int fd = shm_open(name.c_str(), O_RDWR, 0600);
+        if (fd < 0) {
+            throw std::runtime_error("no shm listener at " + address + ": " + std::strerror(errno));
+        }
+
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size < (off_t) sizeof(Header)) {
+            close(fd);
+            return false;
+        }
+        mappedSize = st.st_size;
+
+        map(fd);
+        if (header->magic.load(std::memory_order_acquire) != MAGIC) {
+            unmap();
+            return false;
+        }
+        return true;
+    }
+
+    /**
+     * Unmaps the segment, e.g. when giving up on it.
+     */
+    void unmap() {
+        munmap(header, mappedSize);
+        header = nullptr;
+    }
+
+    /**
+     * Maps the segment behind a file descriptor, closing it afterwards.
+     * \param fd Shared memory file descriptor.
+     */
+    void map(int fd) {
+        void* addr = mmap(nullptr, mappedSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+        if (addr == MAP_FAILED) {
+            throw std::runtime_error("mmap failed for " + name + ": " + std::strerror(errno));
+        }
+        header = static_cast<Header*>(addr);
+    }
+
+    /**
+     * Selects which ring this side writes to.
+     * \param outIndex 0 for the dialer, 1 for the listener.
+     */
+    void attach(int outIndex) {
+        std::uint8_t* data = reinterpret_cast<std::uint8_t*>(header) + sizeof(Header);
+
+        out = &header->rings[outIndex];
+        in = &header->rings[1 - outIndex];
+        outData = data + outIndex * capacity;
+        inData = data + (1 - outIndex) * capacity;
+    }
+
+    /**
+     * Blocks until the outgoing ring has room for a record.
+     * \param head Current producer position.
+     * \param needed Bytes needed, including wrap padding.
+     */
+    void waitForSpace(std::uint64_t head, std::uint64_t needed) {
+        auto hasSpace = [&]() {
+            return capacity - (head - out->tail.load(std::memory_order_acquire)) >= needed;
+        };
+        block(hasSpace, &out->spaceSeq, &out->spaceWaiters);
+    }
+
+    /**
+     * Blocks until the incoming ring has a record past tail.
+     * \param tail Current consumer position.
+     */
+    void waitForData(std::uint64_t tail) {
+        auto hasData = [&]() {
+            return in->head.load(std::memory_order_acquire) != tail;
+        };
+        block(hasData, &in->dataSeq, &in->dataWaiters);
+    }
+
+    /**
+     * Spins for a while and then sleeps on a futex until a condition holds.
+     * \param ready Condition to be waited.
+     * \param seq Futex word bumped by the other side.
+     * \param waiters Sleeper count, so the other side knows to wake us.
+     */
+    template <typename Predicate>
+    void block(Predicate ready, std::atomic<std::uint32_t>* seq, std::atomic<std::uint32_t>* waiters) {
+        for (int i = 0; i < SPIN_COUNT; i++) {
+            if (ready()) {
+                return;
+            }
+        }
+
+        while (!ready()) {
+            if (header->closed.load(std::memory_order_acquire)) {
+                throw std::runtime_error("shm peer closed");
+            }
+
+            waiters->fetch_add(1, std::memory_order_seq_cst);
+            const std::uint32_t value = seq->load(std::memory_order_seq_cst);
+            if (!ready()) {
+                // the timeout lets us notice a peer that died without closing
+                struct timespec timeout = {0, 100000000};
+                syscall(SYS_futex, seq, FUTEX_WAIT, value, &timeout, nullptr, 0);
+            }
+            waiters->fetch_sub(1, std::memory_order_seq_cst);
+        }
+    }
+
+    /**
+     * Hands consumed bytes back to the producer.
+     * \param tail New consumer position.
+     */
+    void release(std::uint64_t tail) {
+        in->tail.store(tail, std::memory_order_release);
+        in->spaceSeq.fetch_add(1, std::memory_order_release);
+        if (in->spaceWaiters.load(std::memory_order_seq_cst) != 0) {
+            wake(&in->spaceSeq);
+        }
+    }
+
+    /**
+     * Wakes every process sleeping on a futex word.
+     * \param word Futex word.
+     */
+    static void wake(std::atomic<std::uint32_t>* word) {
+        syscall(SYS_futex, word, FUTEX_WAKE, INT32_MAX, nullptr, nullptr, 0);
+    }
+
+    /**
+     * Writes a record header.
+     * \param slot Record position.
+     * \param size Payload size or WRAP.
+     */
+    static void writeHeader(std::uint8_t* slot, std::uint32_t size) {
+        std::memcpy(slot, &size, sizeof(size));
+    }
+
+    /**
+     * Size taken by a record in the ring, kept 8-byte aligned.
+     * \param size Payload size.
+     */
+    static std::uint64_t recordSize(std::size_t size) {
+        return (RECORD_HEADER + size + 7) & ~std::uint64_t(7);
+    }
+
+    /**
+     * Size of the whole segment.
+     * \param capacity Capacity of each ring.
+     */
+    static std::size_t segmentSize(std::size_t capacity) {
+        return sizeof(Header) + 2 * capacity;
+    }
+
+    /**
+     * Rounds a capacity up to a power of two.
+     * \param value Requested capacity.
+     */
+    static std::size_t roundCapacity(std::size_t value) {
+        std::size_t result = 4096;
+        while (result < value) {
+            result <<= 1;
+        }
+        return result;
+    }
+
+    /**
+     * Converts a "shm://name" address into a shared memory object name.
+     * \param address Node address.
+     */
+    static std::string objectName(const std::string& address) {
+        const std::string suffix = address.substr(std::strlen(SCHEME));
+        if (suffix.empty() || suffix.find('/') != std::string::npos) {
+            throw std::runtime_error("invalid shm address: " + address);
+        }
+        return "/pairsim." + suffix;
+    }
+};
+
+}
+
+#endif // PAIRSIM_SHM_TRANSPORT_HPP_
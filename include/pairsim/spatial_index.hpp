@@ -0,0 +1,220 @@
+
+#ifndef PAIRSIM_SPATIAL_INDEX_HPP_
+#define PAIRSIM_SPATIAL_INDEX_HPP_
+
+// Standard lib utilities
+#include <cmath>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+// Internal classes
+#include "footprint.hpp"
+#include "position.hpp"
+
+namespace ps {
+
+/**
+ * Uniform grid over entry positions, keyed by small consecutive integers
+ * (the node's device indices). Updates only touch the grid when an entry
+ * changes cells, so moving every entry each tick stays cheap, and range
+ * queries only look at the cells they overlap.
+ */
+class SpatialIndex {
+private:
+    /** Indexed entry. */
+    struct Entry {
+        bool present;
+        std::int64_t cell;
+        Position pos;
+    };
+
+    /** Grid cell edge length. */
+    double cellSize;
+
+    /** Entries by key. */
+    std::vector<Entry> entries;
+
+    /** Keys of the entries in each non-empty cell. */
+    std::unordered_map<std::int64_t, std::vector<std::size_t>> cells;
+
+    /** Number of present entries. */
+    std::size_t count;
+
+public:
+    /**
+     * Creates an empty index.
+     * \param _cellSize Grid cell edge length. Queries are fastest when it
+     * is close to the typical query radius.
+     */
+    SpatialIndex(double _cellSize=1000) : cellSize{_cellSize > 0 ? _cellSize : 1}, count{0} {}
+
+    /**
+     * Changes the cell size, rebuilding the grid.
+     * \param _cellSize Grid cell edge length.
+     */
+    void setCellSize(double _cellSize) {
+        cellSize = _cellSize > 0 ? _cellSize : 1;
+        cells.clear();
+
+        for (std::size_t key = 0; key < entries.size(); key++) {
+            if (entries[key].present) {
+                entries[key].cell = cellOf(entries[key].pos);
+                cells[entries[key].cell].push_back(key);
+            }
+        }
+    }
+
+    /**
+     * Inserts an entry or moves it to a new position.
+     * \param key Entry key.
+     * \param pos Current position.
+     */
+    void update(std::size_t key, const Position& pos) {
+        if (key >= entries.size()) {
+            entries.resize(key + 1, Entry{false, 0, Position{0, 0, 0}});
+        }
+
+        Entry& entry = entries[key];
+        const std::int64_t cell = cellOf(pos);
+
+        if (entry.present && entry.cell != cell) {
+            unlink(key, entry.cell);
+        }
+        if (!entry.present || entry.cell != cell) {
+            cells[cell].push_back(key);
+        }
+        if (!entry.present) {
+            count++;
+        }
+
+        entry.present = true;
+        entry.cell = cell;
+        entry.pos = pos;
+    }
+
+    /**
+     * Removes an entry, if present.
+     * \param key Entry key.
+     */
+    void remove(std::size_t key) {
+        if (key < entries.size() && entries[key].present) {
+            unlink(key, entries[key].cell);
+            entries[key].present = false;
+            count--;
+        }
+    }
+
+    /**
+     * Calls fn(key, position) for every entry inside a box.
+     * \param min Lowest corner.
+     * \param max Highest corner.
+     * \param fn Callback.
+     */
+    template <typename Callback>
+    void query(const Position& min, const Position& max, Callback fn) const {
+        const double spanX = std::floor(max.x / cellSize) - std::floor(min.x / cellSize) + 1;
+        const double spanY = std::floor(max.y / cellSize) - std::floor(min.y / cellSize) + 1;
+        const double spanZ = std::floor(max.z / cellSize) - std::floor(min.z / cellSize) + 1;
+
+        // boxes covering more cells than there are entries are cheaper to scan
+        if (!(spanX * spanY * spanZ <= (double) count)) {
+            for (std::size_t key = 0; key < entries.size(); key++) {
+                if (entries[key].present && inside(entries[key].pos, min, max)) {
+                    fn(key, entries[key].pos);
+                }
+            }
+            return;
+        }
+
+        const std::int64_t x0 = coord(min.x), x1 = coord(max.x);
+        const std::int64_t y0 = coord(min.y), y1 = coord(max.y);
+        const std::int64_t z0 = coord(min.z), z1 = coord(max.z);
+
+        for (std::int64_t x = x0; x <= x1; x++) {
+            for (std::int64_t y = y0; y <= y1; y++) {
+                for (std::int64_t z = z0; z <= z1; z++) {
+                    const auto cell = cells.find(pack(x, y, z));
+                    if (cell == cells.end()) {
+                        continue;
+                    }
+                    for (const std::size_t key : cell->second) {
+                        if (inside(entries[key].pos, min, max)) {
+                            fn(key, entries[key].pos);
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    /**
+     * Estimates the heap memory the index holds.
+     * \returns Bytes.
+     */
+    std::size_t memoryUsage() const {
+        std::size_t bytes = memory::heap(entries) + cells.bucket_count() * sizeof(void*)
+                          + cells.size() * memory::hashNode<std::int64_t, std::vector<std::size_t>>();
+        for (const auto& cell : cells) {
+            bytes += memory::heap(cell.second);
+        }
+        return bytes;
+    }
+
+private:
+    /**
+     * Removes a key from a cell's list.
+     */
+    void unlink(std::size_t key, std::int64_t cell) {
+        const auto it = cells.find(cell);
+        if (it == cells.end()) {
+            return;
+        }
+
+        std::vector<std::size_t>& keys = it->second;
+        for (std::size_t i = 0; i < keys.size(); i++) {
+            if (keys[i] == key) {
+                keys[i] = keys.back();
+                keys.pop_back();
+                break;
+            }
+        }
+        if (keys.empty()) {
+            cells.erase(it);
+        }
+    }
+
+    /**
+     * Grid coordinate along one axis.
+     */
+    std::int64_t coord(double v) const {
+        return (std::int64_t) std::floor(v / cellSize);
+    }
+
+    /**
+     * Cell containing a position.
+     */
+    std::int64_t cellOf(const Position& pos) const {
+        return pack(coord(pos.x), coord(pos.y), coord(pos.z));
+    }
+
+    /**
+     * Packs grid coordinates into a cell key, 21 bits per axis.
+     */
+    static std::int64_t pack(std::int64_t x, std::int64_t y, std::int64_t z) {
+        const std::int64_t mask = (1 << 21) - 1;
+        return ((x & mask) << 42) | ((y & mask) << 21) | (z & mask);
+    }
+
+    /**
+     * Whether a position lies inside a box.
+     */
+    static bool inside(const Position& p, const Position& min, const Position& max) {
+        return p.x >= min.x && p.x <= max.x && p.y >= min.y && p.y <= max.y
+            && p.z >= min.z && p.z <= max.z;
+    }
+};
+
+}
+
+#endif // PAIRSIM_SPATIAL_INDEX_HPP_
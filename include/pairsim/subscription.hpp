@@ -0,0 +1,419 @@
+
+#ifndef PAIRSIM_SUBSCRIPTION_HPP_
+#define PAIRSIM_SUBSCRIPTION_HPP_
+
+// Standard lib utilities
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// JSON handling
+#include <json.hpp>
+using json = nlohmann::json;
+
+// Internal classes
+#include "footprint.hpp"
+#include "position.hpp"
+
+namespace ps {
+
+/**
+ * Detail used for devices up to some distance from an observer.
+ */
+struct LevelOfDetail {
+    /** Farthest distance this level applies to. */
+    double distance;
+
+    /** Send the device every period ticks. */
+    std::uint32_t period;
+
+    /** Numeric fields are rounded to multiples of this, 0 to keep them. */
+    double precision;
+};
+
+/**
+ * Describes which devices, and which of their fields, a node wants to
+ * receive from its peer. An empty subscription means everything, which
+ * is also the default.
+ *
+ * Fields are either top-level keys of Device::serialize()'s result
+ * ("pos") or JSON pointers into it ("/pos/x"). Devices that receive a
+ * field subset must accept partial data in Device::deserialize().
+ *
+ * A subscription can also carry spatial interest: regions (boxes) and
+ * observers (points with a radius). Once any is set, devices reporting a
+ * position (Device::getPosition) outside every region and observer
+ * radius aren't sent at all. Devices inside a region are sent in full;
+ * those only near an observer get the level of detail matching their
+ * distance to the closest one.
+ */
+class Subscription {
+private:
+    /** A single subscription rule. */
+    struct Rule {
+        /** Device type, empty for any type. */
+        std::string deviceType;
+
+        /** Device IDs, empty for any ID. */
+        std::vector<std::uint32_t> ids;
+
+        /** Field paths, empty for all fields. */
+        std::vector<std::string> fields;
+    };
+
+public:
+    /** An axis-aligned box of interest. */
+    struct Region {
+        Position min;
+        Position max;
+    };
+
+    /** A point of interest with a radius. */
+    struct Observer {
+        Position pos;
+        double radius;
+    };
+
+private:
+    /** Rules, a device being subscribed to if it matches any of them. */
+    std::vector<Rule> rules;
+
+    /** Regions of interest. */
+    std::vector<Region> regions;
+
+    /** Observers. */
+    std::vector<Observer> observers;
+
+    /** Levels of detail by increasing distance. */
+    std::vector<LevelOfDetail> levels;
+
+public:
+    /**
+     * Creates an empty subscription, matching everything.
+     */
+    Subscription() {}
+
+    /**
+     * Subscribes to every device of a type.
+     * \param deviceType Device type, empty for any type.
+     * \param fields Field paths to be received, empty for all fields.
+     * \returns This subscription, for chaining.
+     */
+    Subscription& add(std::string deviceType, std::vector<std::string> fields={}) {
+        rules.push_back(Rule{deviceType, {}, fields});
+        return *this;
+    }
+
+    /**
+     * Subscribes to specific devices of a type.
+     * \param deviceType Device type, empty for any type.
+     * \param ids Device IDs.
+     * \param fields Field paths to be received, empty for all fields.
+     * \returns This subscription, for chaining.
+     */
+    Subscription& add(std::string deviceType, std::vector<std::uint32_t> ids, std::vector<std::string> fields={}) {
+        rules.push_back(Rule{deviceType, ids, fields});
+        return *this;
+    }
+
+    /**
+     * Adds a region of interest. Devices inside it are sent in full.
+     * \param min Lowest corner.
+     * \param max Highest corner.
+     * \returns This subscription, for chaining.
+     */
+    Subscription& addRegion(Position min, Position max) {
+        regions.push_back(Region{min, max});
+        return *this;
+    }
+
+    /**
+     * Adds an observer. Devices within its radius are sent with the
+     * level of detail matching their distance.
+     * \param pos Observer position.
+     * \param radius Interest radius.
+     * \returns This subscription, for chaining.
+     */
+    Subscription& addObserver(Position pos, double radius) {
+        observers.push_back(Observer{pos, radius});
+        return *this;
+    }
+
+    /**
+     * Moves an observer, e.g. before sending the subscription again
+     * with Node::subscribe().
+     * \param i Observer index, in the order they were added.
+     * \param pos New position.
+     */
+    void moveObserver(std::size_t i, Position pos) {
+        observers.at(i).pos = pos;
+    }
+
+    /**
+     * Sets the levels of detail for devices near observers. A device uses
+     * the first level whose distance covers it, or the last one if it is
+     * farther than all of them. Without levels, devices are sent in full.
+     * \param _levels Levels by increasing distance.
+     * \returns This subscription, for chaining.
+     */
+    Subscription& setLevelsOfDetail(std::vector<LevelOfDetail> _levels) {
+        levels = _levels;
+        std::sort(levels.begin(), levels.end(), [](const LevelOfDetail& a, const LevelOfDetail& b) {
+            return a.distance < b.distance;
+        });
+        return *this;
+    }
+
+    /**
+     * Whether the subscription is empty, i.e. matches everything.
+     * \returns `true` if there are no rules and no spatial interest.
+     */
+    bool empty() const {
+        return rules.empty() && !spatial();
+    }
+
+    /**
+     * Whether there is spatial interest, i.e. regions or observers.
+     * \returns `true` if devices are filtered by position.
+     */
+    bool spatial() const {
+        return !regions.empty() || !observers.empty();
+    }
+
+    /**
+     * Gets the regions of interest.
+     * \returns Regions.
+     */
+    const std::vector<Region>& getRegions() const {
+        return regions;
+    }
+
+    /**
+     * Gets the observers.
+     * \returns Observers.
+     */
+    const std::vector<Observer>& getObservers() const {
+        return observers;
+    }
+
+    /**
+     * Gets the levels of detail.
+     * \returns Levels by increasing distance.
+     */
+    const std::vector<LevelOfDetail>& getLevelsOfDetail() const {
+        return levels;
+    }
+
+    /**
+     * Index of the level of detail for a distance to an observer.
+     * \param distance Distance to the closest observer.
+     * \returns Level index, or -1 when there are no levels (full detail).
+     */
+    int levelFor(double distance) const {
+        for (std::size_t i = 0; i < levels.size(); i++) {
+            if (distance <= levels[i].distance) {
+                return (int) i;
+            }
+        }
+        return (int) levels.size() - 1;
+    }
+
+    /**
+     * Whether a device is subscribed to.
+     * \param deviceType Device type.
+     * \param id Device ID.
+     * \returns `true` if the device should be sent.
+     */
+    bool matches(const std::string& deviceType, std::uint32_t id) const {
+        if (rules.empty()) {
+            return true;
+        }
+
+        for (const Rule& rule : rules) {
+            if (matches(rule, deviceType, id)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /**
+     * Collects the field paths subscribed for a device.
+     * \param deviceType Device type.
+     * \param id Device ID.
+     * \param fields Output, the union of the matching rules' fields.
+     * \returns `false` if all fields are subscribed, leaving fields empty.
+     */
+    bool fieldsFor(const std::string& deviceType, std::uint32_t id, std::vector<std::string>& fields) const {
+        fields.clear();
+
+        for (const Rule& rule : rules) {
+            if (!matches(rule, deviceType, id)) {
+                continue;
+            }
+            if (rule.fields.empty()) {
+                fields.clear();
+                return false;
+            }
+            for (const std::string& field : rule.fields) {
+                if (std::find(fields.begin(), fields.end(), field) == fields.end()) {
+                    fields.push_back(field);
+                }
+            }
+        }
+
+        return !fields.empty();
+    }
+
+    /**
+     * Keeps only some fields of serialized device data. Missing fields
+     * are skipped.
+     * \param data Result of Device::serialize().
+     * \param fields Field paths to be kept.
+     * \returns Data restricted to the fields.
+     */
+    static json select(const json& data, const std::vector<std::string>& fields) {
+        json result = json::object();
+
+        for (const std::string& field : fields) {
+            if (!field.empty() && field[0] == '/') {
+                const json::json_pointer pointer(field);
+                if (data.contains(pointer)) {
+                    result[pointer] = data.at(pointer);
+                }
+            }
+            else {
+                const auto it = data.find(field);
+                if (it != data.end()) {
+                    result[field] = *it;
+                }
+            }
+        }
+
+        return result;
+    }
+
+    /**
+     * Rounds numeric fields to multiples of a precision, in place.
+     * Power of two precisions also shrink the encoded packet, since the
+     * rounded values then fit in single precision floats.
+     * \param data Serialized device data.
+     * \param precision Rounding step, <= 0 to keep values.
+     */
+    static void quantize(json& data, double precision) {
+        if (precision <= 0) {
+            return;
+        }
+
+        if (data.is_number_float()) {
+            data = std::round(data.get<double>() / precision) * precision;
+        }
+        else if (data.is_structured()) {
+            for (json& value : data) {
+                quantize(value, precision);
+            }
+        }
+    }
+
+    /**
+     * Converts the subscription to JSON, as sent in SUBSCRIBE packets.
+     * \returns Object with the rules, regions, observers and levels.
+     */
+    json toJson() const {
+        json j;
+        j["r"] = json::array();
+        j["g"] = json::array();
+        j["o"] = json::array();
+        j["l"] = json::array();
+
+        for (const Rule& rule : rules) {
+            json r;
+            r["d"] = rule.deviceType;
+            r["i"] = rule.ids;
+            r["f"] = rule.fields;
+            j["r"].push_back(r);
+        }
+        for (const Region& region : regions) {
+            j["g"].push_back(json::array({
+                region.min.x, region.min.y, region.min.z,
+                region.max.x, region.max.y, region.max.z
+            }));
+        }
+        for (const Observer& observer : observers) {
+            j["o"].push_back(json::array({
+                observer.pos.x, observer.pos.y, observer.pos.z, observer.radius
+            }));
+        }
+        for (const LevelOfDetail& level : levels) {
+            j["l"].push_back(json::array({level.distance, level.period, level.precision}));
+        }
+
+        return j;
+    }
+
+    /**
+     * Reads a subscription from a SUBSCRIBE packet's data.
+     * \param j Object produced by toJson().
+     * \returns Subscription.
+     */
+    static Subscription fromJson(const json& j) {
+        Subscription s;
+
+        for (const json& r : j["r"]) {
+            s.rules.push_back(Rule{
+                r["d"].get<std::string>(),
+                r["i"].get<std::vector<std::uint32_t>>(),
+                r["f"].get<std::vector<std::string>>()
+            });
+        }
+        for (const json& g : j["g"]) {
+            s.regions.push_back(Region{
+                Position{g[0].get<double>(), g[1].get<double>(), g[2].get<double>()},
+                Position{g[3].get<double>(), g[4].get<double>(), g[5].get<double>()}
+            });
+        }
+        for (const json& o : j["o"]) {
+            s.observers.push_back(Observer{
+                Position{o[0].get<double>(), o[1].get<double>(), o[2].get<double>()},
+                o[3].get<double>()
+            });
+        }
+        for (const json& l : j["l"]) {
+            s.levels.push_back(LevelOfDetail{
+                l[0].get<double>(), l[1].get<std::uint32_t>(), l[2].get<double>()
+            });
+        }
+
+        return s;
+    }
+
+    /**
+     * Estimates the heap memory the subscription holds.
+     * \returns Bytes.
+     */
+    std::size_t memoryUsage() const {
+        std::size_t bytes = memory::heap(rules) + memory::heap(regions) + memory::heap(observers)
+                          + memory::heap(levels);
+        for (const Rule& rule : rules) {
+            bytes += memory::heap(rule.deviceType) + memory::heap(rule.ids) + memory::heap(rule.fields);
+        }
+        return bytes;
+    }
+
+private:
+    /**
+     * Whether a rule covers a device.
+     */
+    static bool matches(const Rule& rule, const std::string& deviceType, std::uint32_t id) {
+        if (!rule.deviceType.empty() && rule.deviceType != deviceType) {
+            return false;
+        }
+        return rule.ids.empty() || std::find(rule.ids.begin(), rule.ids.end(), id) != rule.ids.end();
+    }
+};
+
+}
+
+#endif // PAIRSIM_SUBSCRIPTION_HPP_
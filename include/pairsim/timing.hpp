@@ -0,0 +1,72 @@
+
+#ifndef PAIRSIM_TIMING_HPP_
+#define PAIRSIM_TIMING_HPP_
+
+// Standard lib utilities
+#include <chrono>
+#include <cstdint>
+
+#include "histogram.hpp"
+
+namespace ps {
+
+/**
+ * Phases of a node's lockstep loop, timed separately when built with
+ * PAIRSIM_TIMING_ENABLED and traced when a trace file is set (see
+ * Node::setTraceFile). GETTING_DATA is split in the model's step and the
+ * serialization of device updates.
+ */
+enum Phase {
+    /** setup(), from dialing or listening until the peer's SETUP. */
+    SETUP_PHASE = 0,
+
+    /** Model::step. */
+    STEP_PHASE = 1,
+
+    /** Queueing device updates and the TICK. */
+    SERIALIZE_PHASE = 2,
+
+    /** flush(), sending the queue to the peer. */
+    SEND_PHASE = 3,
+
+    /** waitTick(), blocked on the peer's TICK and handling the packets
+     * that arrive meanwhile. */
+    WAIT_PHASE = 4,
+
+    PHASE_COUNT = 5,
+};
+
+/**
+ * Gets a phase's name, for reports and traces.
+ * \param phase Phase.
+ * \returns Name, e.g. "step".
+ */
+inline const char* phaseName(Phase phase) {
+    static const char* const names[PHASE_COUNT] = {"setup", "step", "serialize", "send", "wait"};
+    return phase < PHASE_COUNT ? names[phase] : "unknown";
+}
+
+/**
+ * Records the time from its creation to its destruction, in ns, into a
+ * histogram.
+ */
+class PhaseTimer {
+private:
+    Histogram& histogram;
+    std::chrono::steady_clock::time_point start;
+
+public:
+    PhaseTimer(Histogram& _histogram) : histogram{_histogram}, start{std::chrono::steady_clock::now()} {}
+
+    PhaseTimer(const PhaseTimer& rhs) = delete;
+    PhaseTimer& operator=(const PhaseTimer& rhs) = delete;
+
+    ~PhaseTimer() {
+        histogram.record(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start).count());
+    }
+};
+
+}
+
+#endif // PAIRSIM_TIMING_HPP_
@@ -0,0 +1,219 @@
+
+#ifndef PAIRSIM_TRACE_HPP_
+#define PAIRSIM_TRACE_HPP_
+
+// Standard lib utilities
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <stdexcept>
+#include <string>
+
+// POSIX process ID
+#include <unistd.h>
+
+// Internal classes
+#include "capture.hpp"
+#include "packet_type.hpp"
+#include "timing.hpp"
+
+namespace ps {
+
+/**
+ * Writes trace events in the Chrome Trace Event JSON format, loadable in
+ * Perfetto or chrome://tracing. Every event carries the tick index it
+ * belongs to in its args, which tools/tracemerge uses to line the
+ * client's and the server's traces up.
+ *
+ * Timestamps come from the monotonic clock, so traces of peers on the
+ * same host already share a time base.
+ */
+class TraceLog {
+private:
+    /** Output file. */
+    FILE* file;
+
+    /** Whether no event was written yet. */
+    bool first;
+
+    /** Process ID written with every event. */
+    int pid;
+
+public:
+    /**
+     * Creates a trace, truncating the file.
+     * \param path Trace file.
+     */
+    TraceLog(const std::string& path) : file{nullptr}, first{true}, pid{(int) getpid()} {
+        file = std::fopen(path.c_str(), "w");
+        if (file == nullptr) {
+            throw std::runtime_error("Could not open trace file " + path);
+        }
+        std::setvbuf(file, nullptr, _IOFBF, 1 << 20);
+        std::fputs("[\n", file);
+    }
+
+    TraceLog(const TraceLog& rhs) = delete;
+    TraceLog& operator=(const TraceLog& rhs) = delete;
+
+    /**
+     * Closes the trace, completing the JSON array.
+     */
+    ~TraceLog() {
+        std::fputs("\n]\n", file);
+        std::fclose(file);
+    }
+
+    /**
+     * Gets the current time, in ns, in the time base of every trace.
+     * \returns Timestamp.
+     */
+    static std::uint64_t now() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    /**
+     * Names the traced process after the node's role.
+     * \param role Which side of the pair the node is.
+     */
+    void setRole(capture::Role role) {
+        begin();
+        std::fprintf(file, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":0,\"args\":{\"name\":\"%s\"}}",
+                     pid, role == capture::CLIENT ? "client" : "server");
+    }
+
+    /**
+     * Writes a span.
+     * \param category Event category, e.g. "phase".
+     * \param name Event name.
+     * \param start Start timestamp, see now().
+     * \param end End timestamp, see now().
+     * \param tick Tick index.
+     */
+    void complete(const char* category, const char* name, std::uint64_t start, std::uint64_t end, std::uint64_t tick) {
+        begin();
+        std::fprintf(file, "{\"name\":\"");
+        escape(name);
+        std::fprintf(file, "\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":", category);
+        micros(start);
+        std::fputs(",\"dur\":", file);
+        micros(end - start);
+        std::fprintf(file, ",\"pid\":%d,\"tid\":0,\"args\":{\"tick\":%llu}}", pid, (unsigned long long) tick);
+    }
+
+    /**
+     * Writes a packet going out or coming in, as an instant event named
+     * e.g. "send TICK".
+     * \param direction Whether it was sent or received.
+     * \param type Packet type.
+     * \param tick Tick the packet belongs to.
+     * \param size Encoded size, 0 for devices handed over in memory.
+     */
+    void packet(capture::Direction direction, PacketType type, std::uint64_t tick, std::size_t size) {
+        begin();
+        std::fprintf(file, "{\"name\":\"%s %s\",\"cat\":\"packet\",\"ph\":\"i\",\"s\":\"t\",\"ts\":",
+                     direction == capture::SENT ? "send" : "recv", packetName(type));
+        micros(now());
+        std::fprintf(file, ",\"pid\":%d,\"tid\":0,\"args\":{\"tick\":%llu,\"size\":%zu}}",
+                     pid, (unsigned long long) tick, size);
+    }
+
+private:
+    /**
+     * Separates events.
+     */
+    void begin() {
+        if (!first) {
+            std::fputs(",\n", file);
+        }
+        first = false;
+    }
+
+    /**
+     * Writes ns as us with a fractional part, as the format expects.
+     */
+    void micros(std::uint64_t ns) {
+        std::fprintf(file, "%llu.%03llu", (unsigned long long) (ns / 1000), (unsigned long long) (ns % 1000));
+    }
+
+    /**
+     * Writes a string escaped for a JSON string literal.
+     */
+    void escape(const char* s) {
+        for (; *s; s++) {
+            const unsigned char c = *s;
+            if (c == '"' || c == '\\') {
+                std::fputc('\\', file);
+                std::fputc(c, file);
+            }
+            else if (c < 0x20) {
+                std::fprintf(file, "\\u%04x", c);
+            }
+            else {
+                std::fputc(c, file);
+            }
+        }
+    }
+};
+
+/**
+ * Writes a span covering its own lifetime, if the node is tracing, and
+ * optionally adds its duration to a counter. The trace is checked again
+ * at the end, as ending the node closes it.
+ */
+class TraceSpan {
+private:
+    std::unique_ptr<TraceLog>& log;
+    const char* category;
+    const char* name;
+    std::uint64_t tick;
+    std::uint64_t* elapsed;
+    std::uint64_t start;
+
+public:
+    /**
+     * Starts a span.
+     * \param _log Node's trace, may be null.
+     * \param _category Event category.
+     * \param _name Event name, must outlive the span.
+     * \param _tick Tick index.
+     * \param _elapsed Counter the duration is added to, in ns, or null.
+     */
+    TraceSpan(std::unique_ptr<TraceLog>& _log, const char* _category, const char* _name, std::uint64_t _tick,
+              std::uint64_t* _elapsed=nullptr)
+        : log{_log}, category{_category}, name{_name}, tick{_tick}, elapsed{_elapsed},
+          start{_log != nullptr || _elapsed != nullptr ? TraceLog::now() : 0} {}
+
+    /**
+     * Starts a span for a phase.
+     * \param _log Node's trace, may be null.
+     * \param phase Phase.
+     * \param _tick Tick index.
+     * \param _elapsed Counter the duration is added to, in ns, or null.
+     */
+    TraceSpan(std::unique_ptr<TraceLog>& _log, Phase phase, std::uint64_t _tick, std::uint64_t* _elapsed=nullptr)
+        : TraceSpan{_log, "phase", phaseName(phase), _tick, _elapsed} {}
+
+    TraceSpan(const TraceSpan& rhs) = delete;
+    TraceSpan& operator=(const TraceSpan& rhs) = delete;
+
+    ~TraceSpan() {
+        if (start == 0) {
+            return;
+        }
+
+        const std::uint64_t end = TraceLog::now();
+        if (log != nullptr) {
+            log->complete(category, name, start, end, tick);
+        }
+        if (elapsed != nullptr) {
+            *elapsed += end - start;
+        }
+    }
+};
+
+}
+
+#endif // PAIRSIM_TRACE_HPP_
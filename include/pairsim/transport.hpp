@@ -0,0 +1,127 @@
+
+#ifndef PAIRSIM_TRANSPORT_HPP_
+#define PAIRSIM_TRANSPORT_HPP_
+
+// Standard lib utilities
+#include <functional>
+#include <stdexcept>
+#include <string>
+
+// Internal classes
+#include "buffer.hpp"
+#include "device.hpp"
+
+namespace ps {
+
+/**
+ * Statistics kept by a transport's underlying library, for transports
+ * that have them.
+ */
+struct TransportStats {
+    std::uint64_t txMessages;
+    std::uint64_t rxMessages;
+    std::uint64_t txBytes;
+    std::uint64_t rxBytes;
+
+    /** Messages and connections rejected, e.g. by protocol errors. */
+    std::uint64_t rejects;
+
+    /** Connections currently open. */
+    std::uint64_t pipes;
+
+    /** Connections closed so far. */
+    std::uint64_t disconnects;
+};
+
+/**
+ * Message oriented link between a client and a server.
+ * Node selects the implementation from the address scheme, so models
+ * never deal with it directly.
+ */
+class Transport {
+public:
+    /**
+     * Destroys a transport instance, closing the link.
+     */
+    virtual ~Transport() {}
+
+    /**
+     * Waits for the peer on the given address (server side).
+     * \param address Address, e.g. "tcp://localhost:4000".
+     */
+    virtual void listen(const std::string& address) = 0;
+
+    /**
+     * Connects to a listening peer (client side).
+     * \param address Address, e.g. "tcp://localhost:4000".
+     */
+    virtual void dial(const std::string& address) = 0;
+
+    /**
+     * Sends a whole message.
+     * \param data Message bytes.
+     * \param size Message size.
+     */
+    virtual void send(const std::uint8_t* data, std::size_t size) = 0;
+
+    /**
+     * Pushes out anything send() kept buffered. Called once per
+     * Node::flush(), after every queued message was handed over.
+     */
+    virtual void flush() {}
+
+    /**
+     * Receives a whole message, blocking until one is available.
+     * \returns View over the message, valid until the next call.
+     */
+    virtual BufferView recv() = 0;
+
+    /**
+     * Starts waiting for a message without blocking. Used by the
+     * awaitable API; transports that can't do it throw.
+     * \param done Called, possibly from another thread, once recv()
+     * can return (or throw) without blocking.
+     */
+    virtual void recvAsync(std::function<void()> done) {
+        throw std::runtime_error("transport has no asynchronous receive");
+    }
+
+    /**
+     * Whether devices can be handed over in memory, skipping
+     * serialization. Only in-process transports can do that.
+     * \returns `true` if sendDevice() may be used.
+     */
+    virtual bool direct() {
+        return false;
+    }
+
+    /**
+     * Hands a device over to the peer, ordered with send().
+     * Only called when direct() is `true`.
+     * \param device Device whose state the peer should copy.
+     */
+    virtual void sendDevice(Device* device) {
+        throw std::runtime_error("transport can't hand over devices");
+    }
+
+    /**
+     * Device handed over by the message last returned from recv().
+     * \returns The sender's device, or nullptr for regular messages.
+     */
+    virtual Device* receivedDevice() {
+        return nullptr;
+    }
+
+    /**
+     * Reads the underlying library's statistics.
+     * \param stats Filled in if available.
+     * \returns `false` if the transport keeps none.
+     */
+    virtual bool stats(TransportStats& stats) {
+        return false;
+    }
+};
+
+}
+
+#endif // PAIRSIM_TRANSPORT_HPP_
@@ -0,0 +1,46 @@
+#ifndef PAIRSIM_TRANSPORT_FACTORY_HPP_
+#define PAIRSIM_TRANSPORT_FACTORY_HPP_
+
+// Standard lib utilities
+#include <memory>
+#include <string>
+
+// Internal classes
+#include "transport.hpp"
+#include "nng_transport.hpp"
+#include "local_transport.hpp"
+#ifdef __linux__
+#include "shm_transport.hpp"
+#endif
+#ifdef PAIRSIM_URING_ENABLED
+#include "uring_transport.hpp"
+#endif
+
+namespace ps {
+
+/**
+ * Creates the transport matching an address scheme, NNG being the
+ * default for anything that isn't handled natively.
+ * \param address Node address.
+ * \returns Transport instance, not yet connected.
+ */
+inline std::unique_ptr<Transport> makeTransport(const std::string& address) {
+    if (address.rfind(LocalTransport::SCHEME, 0) == 0) {
+        return std::unique_ptr<Transport>(new LocalTransport());
+    }
+#ifdef __linux__
+    if (address.rfind(ShmTransport::SCHEME, 0) == 0) {
+        return std::unique_ptr<Transport>(new ShmTransport());
+    }
+#endif
+#ifdef PAIRSIM_URING_ENABLED
+    if (address.rfind(UringTransport::SCHEME, 0) == 0) {
+        return std::unique_ptr<Transport>(new UringTransport());
+    }
+#endif
+    return std::unique_ptr<Transport>(new NngTransport());
+}
+
+}
+
+#endif // PAIRSIM_TRANSPORT_FACTORY_HPP_
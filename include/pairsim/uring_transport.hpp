@@ -0,0 +1,550 @@
+
+#ifndef PAIRSIM_URING_TRANSPORT_HPP_
+#define PAIRSIM_URING_TRANSPORT_HPP_
+
+// Standard lib utilities
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+// Linux io_uring and sockets
+#include <linux/io_uring.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+// Internal classes
+#include "transport.hpp"
+
+namespace ps {
+
+/**
+ * TCP transport driven by io_uring, selected with
+ * "uring+tcp://host:port" addresses. Messages are framed with a 32-bit
+ * length prefix.
+ *
+ * Outgoing frames are gathered in a registered buffer and written with a
+ * single WRITE_FIXED per flush(). Incoming bytes arrive through one
+ * multishot RECV backed by a provided buffer ring, so a steady stream
+ * of messages costs no re-arming. Needs Linux 6.0 or newer.
+ *
+ * The listener accepts a single peer, lazily on first use, as pairs
+ * only ever talk to one other node.
+ */
+class UringTransport : public Transport {
+public:
+    /** Address prefix that selects this transport. */
+    static constexpr const char* SCHEME = "uring+tcp://";
+
+private:
+    static constexpr unsigned QUEUE_DEPTH = 8;
+    static constexpr std::size_t SEND_BUFFER_SIZE = 1 << 20;
+    static constexpr unsigned RECV_BUFFER_COUNT = 64;
+    static constexpr std::size_t RECV_BUFFER_SIZE = 1 << 16;
+    static constexpr std::uint16_t BUFFER_GROUP = 0;
+    static constexpr std::uint64_t RECV_TAG = 1;
+    static constexpr std::uint64_t SEND_TAG = 2;
+    static constexpr std::size_t FRAME_HEADER = 4;
+
+    /** Ring file descriptor. */
+    int ringFd;
+
+    /** Listening socket, server side only. */
+    int listenFd;
+
+    /** Connected socket. */
+    int sockFd;
+
+    /** Submission queue ring mapping. */
+    void* sqRing;
+    std::size_t sqRingSize;
+    unsigned* sqTail;
+    unsigned* sqMask;
+    unsigned* sqArray;
+
+    /** Submission queue entries mapping. */
+    io_uring_sqe* sqes;
+    std::size_t sqesSize;
+
+    /** Completion queue ring mapping, may alias sqRing. */
+    void* cqRing;
+    std::size_t cqRingSize;
+    unsigned* cqHead;
+    unsigned* cqTail;
+    unsigned* cqMask;
+    io_uring_cqe* cqes;
+
+    /** SQEs written but not yet handed to the kernel. */
+    unsigned toSubmit;
+
+    /** Registered send buffer, index 0. */
+    std::uint8_t* sendBuffer;
+
+    /** Bytes gathered in sendBuffer. */
+    std::size_t sendUsed;
+
+    /** Result of the last WRITE_FIXED, valid when sendDone. */
+    int sendResult;
+    bool sendDone;
+
+    /**
+     * Provided buffer ring for multishot receives. Its tail overlays the
+     * first entry's resv field; io_uring_buf_ring is not used because
+     * C++ lays out its flexible array differently from C.
+     */
+    io_uring_buf* bufRing;
+    std::size_t bufRingSize;
+    std::uint8_t* recvBuffers;
+    std::uint16_t bufTail;
+
+    /** Whether the multishot RECV is still armed. */
+    bool recvArmed;
+
+    /** Bytes received by completions but not yet framed. */
+    Buffer incoming;
+
+    /** Framing buffer, only touched by recv() so views stay valid. */
+    Buffer assembly;
+
+    /** Start of the unread data in assembly. */
+    std::size_t assemblyStart;
+
+    /** Size of the frame returned by the last recv(). */
+    std::size_t lastFrame;
+
+public:
+    /**
+     * Creates an io_uring transport, setting up the ring and its
+     * registered buffers.
+     */
+    UringTransport()
+        : ringFd{-1}, listenFd{-1}, sockFd{-1}, sqRing{nullptr}, sqRingSize{0}, sqTail{nullptr},
+          sqMask{nullptr}, sqArray{nullptr}, sqes{nullptr}, sqesSize{0}, cqRing{nullptr},
+          cqRingSize{0}, cqHead{nullptr}, cqTail{nullptr}, cqMask{nullptr}, cqes{nullptr},
+          toSubmit{0}, sendBuffer{nullptr}, sendUsed{0}, sendResult{0}, sendDone{false},
+          bufRing{nullptr}, bufRingSize{0}, recvBuffers{nullptr}, bufTail{0}, recvArmed{false},
+          assemblyStart{0}, lastFrame{0} {
+        setupRing();
+        setupBuffers();
+    }
+
+    /**
+     * Destroys the transport. Closing the ring cancels whatever is
+     * still in flight before the buffers go away.
+     */
+    ~UringTransport() {
+        if (ringFd >= 0) {
+            close(ringFd);
+        }
+        if (sqes != nullptr) {
+            munmap(sqes, sqesSize);
+        }
+        if (cqRing != nullptr && cqRing != sqRing) {
+            munmap(cqRing, cqRingSize);
+        }
+        if (sqRing != nullptr) {
+            munmap(sqRing, sqRingSize);
+        }
+        if (bufRing != nullptr) {
+            munmap(bufRing, bufRingSize);
+        }
+        if (recvBuffers != nullptr) {
+            munmap(recvBuffers, RECV_BUFFER_COUNT * RECV_BUFFER_SIZE);
+        }
+        if (sendBuffer != nullptr) {
+            munmap(sendBuffer, SEND_BUFFER_SIZE);
+        }
+        if (sockFd >= 0) {
+            close(sockFd);
+        }
+        if (listenFd >= 0) {
+            close(listenFd);
+        }
+    }
+
+    void listen(const std::string& address) {
+        addrinfo* info = resolve(address, true);
+
+        listenFd = socket(info->ai_family, SOCK_STREAM, 0);
+        if (listenFd < 0) {
+            const int error = errno;
+            freeaddrinfo(info);
+            throw std::runtime_error("cannot listen on " + address + ": " + std::strerror(error));
+        }
+
+        const int yes = 1;
+        setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+
+        const bool ok = bind(listenFd, info->ai_addr, info->ai_addrlen) == 0
+            && ::listen(listenFd, 1) == 0;
+        freeaddrinfo(info);
+
+        if (!ok) {
+            throw std::runtime_error("cannot listen on " + address + ": " + std::strerror(errno));
+        }
+    }
+
+    void dial(const std::string& address) {
+        addrinfo* info = resolve(address, false);
+
+        sockFd = socket(info->ai_family, SOCK_STREAM, 0);
+        const bool ok = sockFd >= 0 && connect(sockFd, info->ai_addr, info->ai_addrlen) == 0;
+        freeaddrinfo(info);
+
+        if (!ok) {
+            throw std::runtime_error("cannot dial " + address + ": " + std::strerror(errno));
+        }
+
+        connected();
+    }
+
+    void send(const std::uint8_t* data, std::size_t size) {
+        const std::uint32_t length = size;
+        gather(reinterpret_cast<const std::uint8_t*>(&length), FRAME_HEADER);
+        gather(data, size);
+    }
+
+    void flush() {
+        ensureConnected();
+
+        std::size_t offset = 0;
+        while (offset < sendUsed) {
+            io_uring_sqe* sqe = nextSqe();
+            sqe->opcode = IORING_OP_WRITE_FIXED;
+            sqe->fd = sockFd;
+            sqe->addr = reinterpret_cast<std::uint64_t>(sendBuffer + offset);
+            sqe->len = sendUsed - offset;
+            sqe->buf_index = 0;
+            sqe->user_data = SEND_TAG;
+
+            sendDone = false;
+            while (!sendDone) {
+                reap(true);
+            }
+            if (sendResult < 0) {
+                throw std::runtime_error(std::string("io_uring write failed: ") + std::strerror(-sendResult));
+            }
+            offset += sendResult;
+        }
+
+        sendUsed = 0;
+    }
+
+    BufferView recv() {
+        ensureConnected();
+
+        assemblyStart += lastFrame;
+        lastFrame = 0;
+
+        for (;;) {
+            const std::size_t available = assembly.size() - assemblyStart;
+            if (available >= FRAME_HEADER) {
+                std::uint32_t length;
+                std::memcpy(&length, assembly.data() + assemblyStart, FRAME_HEADER);
+
+                if (available >= FRAME_HEADER + length) {
+                    lastFrame = FRAME_HEADER + length;
+                    return BufferView{assembly.data() + assemblyStart + FRAME_HEADER, length};
+                }
+            }
+
+            // keeps only the partial frame before taking in more bytes
+            assembly.erase(assembly.begin(), assembly.begin() + assemblyStart);
+            assemblyStart = 0;
+
+            while (incoming.empty()) {
+                reap(true);
+            }
+            assembly.insert(assembly.end(), incoming.begin(), incoming.end());
+            incoming.clear();
+        }
+    }
+
+private:
+    /**
+     * Creates the ring and maps its queues.
+     */
+    void setupRing() {
+        io_uring_params params;
+        std::memset(&params, 0, sizeof(params));
+
+        ringFd = syscall(__NR_io_uring_setup, QUEUE_DEPTH, &params);
+        if (ringFd < 0) {
+            throw std::runtime_error(std::string("io_uring_setup failed: ") + std::strerror(errno));
+        }
+
+        sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        const bool singleMmap = params.features & IORING_FEAT_SINGLE_MMAP;
+        if (singleMmap) {
+            sqRingSize = cqRingSize = std::max(sqRingSize, cqRingSize);
+        }
+
+        sqRing = mapRing(sqRingSize, IORING_OFF_SQ_RING);
+        cqRing = singleMmap ? sqRing : mapRing(cqRingSize, IORING_OFF_CQ_RING);
+        sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+        sqes = static_cast<io_uring_sqe*>(mapRing(sqesSize, IORING_OFF_SQES));
+
+        std::uint8_t* sq = static_cast<std::uint8_t*>(sqRing);
+        sqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+        sqMask = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+
+        std::uint8_t* cq = static_cast<std::uint8_t*>(cqRing);
+        cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+        cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+        cqMask = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+        cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+    }
+
+    /**
+     * Registers the send buffer and the provided receive buffer ring.
+     */
+    void setupBuffers() {
+        sendBuffer = static_cast<std::uint8_t*>(mapAnonymous(SEND_BUFFER_SIZE));
+
+        iovec iov = {sendBuffer, SEND_BUFFER_SIZE};
+        if (syscall(__NR_io_uring_register, ringFd, IORING_REGISTER_BUFFERS, &iov, 1) != 0) {
+            throw std::runtime_error(std::string("io_uring buffer registration failed: ") + std::strerror(errno));
+        }
+
+        bufRingSize = RECV_BUFFER_COUNT * sizeof(io_uring_buf);
+        bufRing = static_cast<io_uring_buf*>(mapAnonymous(bufRingSize));
+        recvBuffers = static_cast<std::uint8_t*>(mapAnonymous(RECV_BUFFER_COUNT * RECV_BUFFER_SIZE));
+
+        io_uring_buf_reg reg;
+        std::memset(&reg, 0, sizeof(reg));
+        reg.ring_addr = reinterpret_cast<std::uint64_t>(bufRing);
+        reg.ring_entries = RECV_BUFFER_COUNT;
+        reg.bgid = BUFFER_GROUP;
+        if (syscall(__NR_io_uring_register, ringFd, IORING_REGISTER_PBUF_RING, &reg, 1) != 0) {
+            throw std::runtime_error(std::string("io_uring provided buffer ring unsupported: ") + std::strerror(errno));
+        }
+
+        for (std::uint16_t i = 0; i < RECV_BUFFER_COUNT; i++) {
+            recycle(i);
+        }
+    }
+
+    /**
+     * Accepts the peer if this is the listening side and nobody
+     * connected yet.
+     */
+    void ensureConnected() {
+        if (sockFd >= 0) {
+            return;
+        }
+        if (listenFd < 0) {
+            throw std::runtime_error("uring transport is neither dialed nor listening");
+        }
+
+        sockFd = accept(listenFd, nullptr, nullptr);
+        if (sockFd < 0) {
+            throw std::runtime_error(std::string("accept failed: ") + std::strerror(errno));
+        }
+
+        connected();
+    }
+
+    /**
+     * Tunes a freshly connected socket and arms the receive.
+     */
+    void connected() {
+        const int yes = 1;
+        setsockopt(sockFd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+        armRecv();
+    }
+
+    /**
+     * Queues the multishot RECV. It is submitted together with the
+     * next write or wait.
+     */
+    void armRecv() {
+        io_uring_sqe* sqe = nextSqe();
+        sqe->opcode = IORING_OP_RECV;
+        sqe->fd = sockFd;
+        sqe->flags = IOSQE_BUFFER_SELECT;
+        sqe->ioprio = IORING_RECV_MULTISHOT;
+        sqe->buf_group = BUFFER_GROUP;
+        sqe->user_data = RECV_TAG;
+        recvArmed = true;
+    }
+
+    /**
+     * Copies bytes into the send buffer, flushing whenever it fills up.
+     * \param data Bytes to be sent.
+     * \param size Number of bytes.
+     */
+    void gather(const std::uint8_t* data, std::size_t size) {
+        while (size > 0) {
+            if (sendUsed == SEND_BUFFER_SIZE) {
+                flush();
+            }
+
+            const std::size_t chunk = std::min(size, SEND_BUFFER_SIZE - sendUsed);
+            std::memcpy(sendBuffer + sendUsed, data, chunk);
+            sendUsed += chunk;
+            data += chunk;
+            size -= chunk;
+        }
+    }
+
+    /**
+     * Takes the next free SQE, zeroed.
+     * \returns SQE to be filled; it is published right away and goes to
+     * the kernel on the next reap().
+     */
+    io_uring_sqe* nextSqe() {
+        const unsigned tail = *sqTail;
+        const unsigned index = tail & *sqMask;
+        io_uring_sqe* sqe = &sqes[index];
+
+        std::memset(sqe, 0, sizeof(*sqe));
+        sqArray[index] = index;
+        __atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);
+        toSubmit++;
+
+        return sqe;
+    }
+
+    /**
+     * Submits pending SQEs and processes completions.
+     * \param wait Whether to block until at least one completion arrives.
+     */
+    void reap(bool wait) {
+        const int r = syscall(__NR_io_uring_enter, ringFd, toSubmit, wait ? 1 : 0,
+                              wait ? IORING_ENTER_GETEVENTS : 0, nullptr, 0);
+        if (r < 0 && errno != EINTR) {
+            throw std::runtime_error(std::string("io_uring_enter failed: ") + std::strerror(errno));
+        }
+        if (r > 0) {
+            toSubmit -= r;
+        }
+
+        unsigned head = *cqHead;
+        const unsigned tail = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+        for (; head != tail; head++) {
+            const io_uring_cqe* cqe = &cqes[head & *cqMask];
+            if (cqe->user_data == RECV_TAG) {
+                handleRecv(cqe);
+            }
+            else if (cqe->user_data == SEND_TAG) {
+                sendResult = cqe->res;
+                sendDone = true;
+            }
+        }
+        __atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+
+        if (!recvArmed && sockFd >= 0) {
+            armRecv();
+        }
+    }
+
+    /**
+     * Handles a RECV completion, moving its bytes out of the provided
+     * buffer and handing the buffer back.
+     * \param cqe Completion entry.
+     */
+    void handleRecv(const io_uring_cqe* cqe) {
+        if (!(cqe->flags & IORING_CQE_F_MORE)) {
+            recvArmed = false;
+        }
+
+        if (cqe->res == 0) {
+            throw std::runtime_error("uring peer closed");
+        }
+        if (cqe->res < 0) {
+            // running out of provided buffers only stops the multishot
+            if (cqe->res != -ENOBUFS) {
+                throw std::runtime_error(std::string("io_uring recv failed: ") + std::strerror(-cqe->res));
+            }
+            return;
+        }
+
+        const std::uint16_t bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+        const std::uint8_t* data = recvBuffers + bid * RECV_BUFFER_SIZE;
+        incoming.insert(incoming.end(), data, data + cqe->res);
+        recycle(bid);
+    }
+
+    /**
+     * Returns a buffer to the provided buffer ring.
+     * \param bid Buffer ID.
+     */
+    void recycle(std::uint16_t bid) {
+        io_uring_buf* buf = &bufRing[bufTail & (RECV_BUFFER_COUNT - 1)];
+        buf->addr = reinterpret_cast<std::uint64_t>(recvBuffers + bid * RECV_BUFFER_SIZE);
+        buf->len = RECV_BUFFER_SIZE;
+        buf->bid = bid;
+        bufTail++;
+        __atomic_store_n(&bufRing[0].resv, bufTail, __ATOMIC_RELEASE);
+    }
+
+    /**
+     * Maps one of the ring's regions.
+     * \param size Region size.
+     * \param offset Region magic offset.
+     */
+    void* mapRing(std::size_t size, off_t offset) {
+        void* addr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, offset);
+        if (addr == MAP_FAILED) {
+            throw std::runtime_error(std::string("io_uring mmap failed: ") + std::strerror(errno));
+        }
+        return addr;
+    }
+
+    /**
+     * Allocates page-aligned memory.
+     * \param size Number of bytes.
+     */
+    static void* mapAnonymous(std::size_t size) {
+        void* addr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (addr == MAP_FAILED) {
+            throw std::runtime_error(std::string("mmap failed: ") + std::strerror(errno));
+        }
+        return addr;
+    }
+
+    /**
+     * Resolves a "uring+tcp://host:port" address.
+     * \param address Node address.
+     * \param passive Whether the result is meant for bind().
+     */
+    static addrinfo* resolve(const std::string& address, bool passive) {
+        const std::string hostPort = address.substr(std::strlen(SCHEME));
+        const std::size_t colon = hostPort.rfind(':');
+        if (colon == std::string::npos) {
+            throw std::runtime_error("invalid uring address: " + address);
+        }
+
+        std::string host = hostPort.substr(0, colon);
+        const std::string port = hostPort.substr(colon + 1);
+        if (host.size() > 1 && host.front() == '[' && host.back() == ']') {
+            host = host.substr(1, host.size() - 2);
+        }
+
+        addrinfo hints;
+        std::memset(&hints, 0, sizeof(hints));
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        hints.ai_flags = passive ? AI_PASSIVE : 0;
+
+        addrinfo* info = nullptr;
+        const int r = getaddrinfo(host.empty() || host == "*" ? nullptr : host.c_str(), port.c_str(), &hints, &info);
+        if (r != 0) {
+            throw std::runtime_error("cannot resolve " + address + ": " + gai_strerror(r));
+        }
+        return info;
+    }
+};
+
+}
+
+#endif // PAIRSIM_URING_TRANSPORT_HPP_
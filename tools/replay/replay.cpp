@@ -0,0 +1,27 @@
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+
+#include <pairsim/replay.hpp>
+
+int main(int argc, char** argv) {
+    if (argc < 3) {
+        std::cerr << "usage: " << argv[0] << " <capture> <address> [speed]" << std::endl;
+        std::cerr << "  speed: 1 for the recorded timing, 0 (default) for maximum" << std::endl;
+        return 1;
+    }
+
+    ps::ReplayPeer peer(argv[1], argv[2]);
+    if (argc > 3) {
+        peer.setSpeed(std::atof(argv[3]));
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+    peer.run();
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    std::cout << "sent " << peer.getSentCount() << " packets, received "
+              << peer.getReceivedCount() << " in " << elapsed.count() << " s" << std::endl;
+
+    return 0;
+}
@@ -0,0 +1,186 @@
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <json.hpp>
+using json = nlohmann::json;
+
+/**
+ * Trace of one side, as written by Node::setTraceFile.
+ */
+struct Side {
+    json events;
+
+    /** Timestamps of TICK packets, by tick index. */
+    std::map<std::uint64_t, double> sentTicks;
+    std::map<std::uint64_t, double> receivedTicks;
+
+    /** Total time in the wait phase, in us. */
+    double waiting = 0;
+    size_t waits = 0;
+};
+
+/**
+ * Reads a trace, completing it if its node never ended.
+ */
+static json load(const std::string& path) {
+    std::ifstream in(path);
+    if (!in) {
+        throw std::runtime_error("Could not open " + path);
+    }
+
+    std::stringstream ss;
+    ss << in.rdbuf();
+    std::string text = ss.str();
+
+    json events = json::parse(text, nullptr, false);
+    if (events.is_discarded()) {
+        while (!text.empty() && (std::isspace((unsigned char) text.back()) || text.back() == ',')) {
+            text.pop_back();
+        }
+        events = json::parse(text + "]");
+    }
+    if (events.is_object()) {
+        events = events["traceEvents"];
+    }
+    return events;
+}
+
+static Side read(const std::string& path) {
+    Side side;
+    side.events = load(path);
+
+    for (const json& e : side.events) {
+        if (!e.contains("args") || !e["args"].contains("tick")) {
+            continue;
+        }
+
+        const std::string name = e["name"];
+        const std::uint64_t tick = e["args"]["tick"];
+
+        if (name == "send TICK") {
+            side.sentTicks[tick] = e["ts"];
+        }
+        else if (name == "recv TICK") {
+            side.receivedTicks[tick] = e["ts"];
+        }
+        else if (name == "wait" && e["ph"] == "X") {
+            side.waiting += e["dur"].get<double>();
+            side.waits++;
+        }
+    }
+
+    return side;
+}
+
+/**
+ * Estimates how far ahead the server's clock is from the client's, NTP
+ * style: each tick is a round trip, client TICK n going out and server
+ * TICK n coming back, so the offset is the mean of the two one-way
+ * differences. The median over all ticks is taken.
+ */
+static double offset(const Side& client, const Side& server, size_t& samples) {
+    std::vector<double> offsets;
+
+    for (const auto& sent : client.sentTicks) {
+        const auto serverReceived = server.receivedTicks.find(sent.first);
+        const auto serverSent = server.sentTicks.find(sent.first);
+        const auto received = client.receivedTicks.find(sent.first);
+
+        if (serverReceived == server.receivedTicks.end() || serverSent == server.sentTicks.end()
+            || received == client.receivedTicks.end()) {
+            continue;
+        }
+
+        offsets.push_back(((serverReceived->second - sent.second) + (serverSent->second - received->second)) / 2);
+    }
+
+    samples = offsets.size();
+    if (offsets.empty()) {
+        return 0;
+    }
+
+    std::nth_element(offsets.begin(), offsets.begin() + offsets.size() / 2, offsets.end());
+    return offsets[offsets.size() / 2];
+}
+
+/**
+ * Appends a side's events under a new pid, shifted in time.
+ */
+static void append(json& out, const Side& side, int pid, const std::string& name, double shift) {
+    out.push_back({{"name", "process_name"}, {"ph", "M"}, {"pid", pid}, {"tid", 0}, {"args", {{"name", name}}}});
+    out.push_back({{"name", "process_sort_index"}, {"ph", "M"}, {"pid", pid}, {"tid", 0}, {"args", {{"sort_index", pid}}}});
+
+    for (json e : side.events) {
+        if (e["ph"] == "M") {
+            continue;
+        }
+        e["pid"] = pid;
+        if (e.contains("ts")) {
+            e["ts"] = e["ts"].get<double>() - shift;
+        }
+        out.push_back(e);
+    }
+}
+
+/**
+ * Draws an arrow for each TICK, from its send to its receipt.
+ */
+static void link(json& out, const Side& from, int fromPid, double fromShift,
+                 const Side& to, int toPid, double toShift, int idBase) {
+    for (const auto& sent : from.sentTicks) {
+        const auto received = to.receivedTicks.find(sent.first);
+        if (received == to.receivedTicks.end()) {
+            continue;
+        }
+
+        const std::uint64_t id = sent.first * 2 + idBase;
+        out.push_back({{"name", "TICK"}, {"cat", "lockstep"}, {"ph", "s"}, {"id", id},
+                       {"pid", fromPid}, {"tid", 0}, {"ts", sent.second - fromShift}});
+        out.push_back({{"name", "TICK"}, {"cat", "lockstep"}, {"ph", "f"}, {"bp", "e"}, {"id", id},
+                       {"pid", toPid}, {"tid", 0}, {"ts", received->second - toShift}});
+    }
+}
+
+int main(int argc, char** argv) {
+    if (argc < 4) {
+        std::cerr << "usage: " << argv[0] << " <client trace> <server trace> <output>" << std::endl;
+        return 1;
+    }
+
+    const Side client = read(argv[1]);
+    const Side server = read(argv[2]);
+
+    size_t samples = 0;
+    const double shift = offset(client, server, samples);
+
+    json events = json::array();
+    append(events, client, 1, "client", 0);
+    append(events, server, 2, "server", shift);
+    link(events, client, 1, 0, server, 2, shift, 0);
+    link(events, server, 2, shift, client, 1, 0, 1);
+
+    std::ofstream out(argv[3]);
+    out << json{{"traceEvents", events}, {"displayTimeUnit", "ns"}}.dump() << std::endl;
+    if (!out) {
+        std::cerr << "Could not write " << argv[3] << std::endl;
+        return 1;
+    }
+
+    if (samples == 0) {
+        std::cerr << "warning: no TICK was seen by both sides, clocks were not aligned" << std::endl;
+    }
+
+    std::cout << "server clock offset " << shift << " us, from " << samples << " ticks" << std::endl;
+    std::cout << "client waited " << client.waiting / 1000 << " ms over " << client.waits << " ticks, server "
+              << server.waiting / 1000 << " ms over " << server.waits << " ticks" << std::endl;
+
+    return 0;
+}
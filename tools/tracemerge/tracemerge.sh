@@ -0,0 +1 @@
+g++ tracemerge.cpp -o tracemerge -std=c++17 -O2 -I../../include -I../../examples/omnet_module/src/include -Wall